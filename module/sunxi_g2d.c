@@ -8,11 +8,13 @@
  */
 
 #include <linux/clk.h>
+#include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
 #include <linux/mod_devicetable.h>
 #include <linux/module.h>
+#include <linux/of_device.h>
 #include <linux/platform_device.h>
 #include <linux/pm_runtime.h>
 #include <linux/reset.h>
@@ -34,16 +36,315 @@
 /* Rectfill specific ctrls */
 #define V4L2_CID_SUNXI_G2D_RECTFILL_COLOR		(V4L2_CID_CUSTOM_BASE + 6)
 #define V4L2_CID_SUNXI_G2D_RECTFILL_COLOR_ALPHA	(V4L2_CID_CUSTOM_BASE + 7)
+#define V4L2_CID_SUNXI_G2D_RECTFILL_RECTS		(V4L2_CID_CUSTOM_BASE + 15)
+#define V4L2_CID_SUNXI_G2D_RECTFILL_NUM_RECTS	(V4L2_CID_CUSTOM_BASE + 16)
+/* Blend specific ctrls */
+#define V4L2_CID_SUNXI_G2D_BLEND_MODE			(V4L2_CID_CUSTOM_BASE + 8)
+#define V4L2_CID_SUNXI_G2D_IN_GLOBAL_ALPHA		(V4L2_CID_CUSTOM_BASE + 9)
+#define V4L2_CID_SUNXI_G2D_COLORKEY_MODE		(V4L2_CID_CUSTOM_BASE + 10)
+#define V4L2_CID_SUNXI_G2D_COLORKEY_MIN			(V4L2_CID_CUSTOM_BASE + 11)
+#define V4L2_CID_SUNXI_G2D_COLORKEY_MAX			(V4L2_CID_CUSTOM_BASE + 12)
+/* Raster operation specific ctrls */
+#define V4L2_CID_SUNXI_G2D_ROP_CODE				(V4L2_CID_CUSTOM_BASE + 13)
+#define V4L2_CID_SUNXI_G2D_ROP_PATTERN_COLOR	(V4L2_CID_CUSTOM_BASE + 14)
+/* Compose specific ctrls */
+#define V4L2_CID_SUNXI_G2D_COMPOSE_LAYERS		(V4L2_CID_CUSTOM_BASE + 17)
+#define V4L2_CID_SUNXI_G2D_COMPOSE_NUM_LAYERS	(V4L2_CID_CUSTOM_BASE + 18)
+#define V4L2_CID_SUNXI_G2D_FADE_ALPHA		(V4L2_CID_CUSTOM_BASE + 19)
+#define V4L2_CID_SUNXI_G2D_MOVE_OFFSET		(V4L2_CID_CUSTOM_BASE + 20)
 
-/* 
- * TODO: Add all supported formats. For now only include formats that
- * are supported by the G2D engine both as input and as output
+/*
+ * V4L2 names RGB formats after their byte order in memory while the G2D
+ * names them after the order of the fields in a little endian word, hence
+ * V4L2_PIX_FMT_XBGR32 being G2D_FORMAT_XRGB8888. The same goes for YUV, so
+ * YUYV is G2D_FORMAT_IYUV422_V0Y1U0Y0 and NV12, whose chroma plane starts
+ * with U, G2D_FORMAT_YUV420UVC_V1U1V0U0. Packed YUV 4:2:2 can only be
+ * fetched, the write-back unit does not produce it. The M variants of
+ * the YUV formats take each plane from a buffer of its own. The 10-bit
+ * formats are named after the word layout on both sides, P010 keeping each
+ * sample in the top bits of a little endian 16-bit word. The G2D also does
+ * a 4:2:2 version of it, which V4L2 has no fourcc for.
  */
 static struct g2d_fmt g2d_supported_fmts[] = {
 	{
 		.fourcc	= V4L2_PIX_FMT_XBGR32,
 		.depth	= 32,
+		.hw_id  = G2D_FORMAT_XRGB8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ABGR32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_ARGB8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGBA32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_ABGR8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_BGRA32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_RGBA8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ARGB32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_BGRA8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGBX32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_XBGR8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_BGRX32,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_RGBX8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_XRGB32,
+		.depth	= 32,
 		.hw_id  = G2D_FORMAT_BGRX8888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_BGR24,
+		.depth	= 24,
+		.hw_id  = G2D_FORMAT_RGB888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGB24,
+		.depth	= 24,
+		.hw_id  = G2D_FORMAT_BGR888,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGB565,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_RGB565,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ARGB444,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_ARGB4444,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ABGR444,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_ABGR4444,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGBA444,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_RGBA4444,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_BGRA444,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_BGRA4444,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ARGB555,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_ARGB1555,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ABGR555,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_ABGR1555,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGBA555,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_RGBA5551,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_BGRA555,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_BGRA5551,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_ARGB2101010,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_ARGB2101010,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST | G2D_FMT_10BIT,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_RGBA1010102,
+		.depth	= 32,
+		.hw_id  = G2D_FORMAT_RGBA1010102,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST | G2D_FMT_10BIT,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUYV,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_IYUV422_V0Y1U0Y0,
+		.flags	= G2D_FMT_SRC,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_UYVY,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_IYUV422_Y1V0Y0U0,
+		.flags	= G2D_FMT_SRC,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YVYU,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_IYUV422_U0Y1V0Y0,
+		.flags	= G2D_FMT_SRC,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_VYUY,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_IYUV422_Y1U0Y0V0,
+		.flags	= G2D_FMT_SRC,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV16,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422UVC_V1U1V0U0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV61,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422UVC_U1V1U0V0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUV422P,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422_PLANAR,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV12,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420UVC_V1U1V0U0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV21,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420UVC_U1V1U0V0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUV420,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420_PLANAR,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUV411P,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV411_PLANAR,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_GREY,
+		.depth	= 8,
+		.hw_id  = G2D_FORMAT_Y8,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_P010,
+		.depth	= 24,
+		.hw_id  = G2D_FORMAT_YVU10_P010,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST | G2D_FMT_10BIT,
+		.num_planes = 1,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV16M,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422UVC_V1U1V0U0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 2,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV61M,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422UVC_U1V1U0V0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 2,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUV422M,
+		.depth	= 16,
+		.hw_id  = G2D_FORMAT_YUV422_PLANAR,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 3,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV12M,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420UVC_V1U1V0U0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 2,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_NV21M,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420UVC_U1V1U0V0,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 2,
+	},
+	{
+		.fourcc	= V4L2_PIX_FMT_YUV420M,
+		.depth	= 12,
+		.hw_id  = G2D_FORMAT_YUV420_PLANAR,
+		.flags	= G2D_FMT_SRC | G2D_FMT_DST,
+		.num_planes = 3,
 	},
 };
 
@@ -54,11 +355,18 @@ static struct g2d_fmt g2d_supported_fmts[] = {
 #define DEF_PIX_FMT V4L2_PIX_FMT_XBGR32
 #define DEF_RECTFILL_COLOR 0xffff0100
 #define DEF_RECTFILL_COLOR_ALPHA 0xff
+#define DEF_BLEND_MODE G2D_BLD_SRC_OVER
+#define DEF_GLOBAL_ALPHA 0xff
+#define DEF_COLORKEY 0x000000
+#define DEF_ROP_CODE 0xcc /* SRCCOPY */
+#define DEF_ROP_PATTERN_COLOR 0xff000000
+#define DEF_COMPOSE_NUM_LAYERS 1
+#define DEF_FADE_ALPHA 0xff
 
 #define MIN_SRC_BUFS 1
 #define MIN_DST_BUFS 1
 
-struct g2d_fmt *find_fmt(struct v4l2_pix_format *v4l2_pix_fmt)
+struct g2d_fmt *find_fmt(struct v4l2_pix_format_mplane *v4l2_pix_fmt)
 {
 	unsigned int i;
 	for (i = 0; i < NUM_SUPPORTED_FMTS; i++) {
@@ -74,30 +382,117 @@ static inline struct sunxi_g2d_ctx *g2d_file2ctx(struct file *file)
 	return container_of(file->private_data, struct sunxi_g2d_ctx, fh);
 }
 
-/** TODO:
- * - Add support for V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE and
- *   V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE
-*/
+/*
+ * The queues are multi-planar, but the core hands selections over with the
+ * single-planar buffer types
+ */
 static struct g2d_frame *get_frame(struct sunxi_g2d_ctx *ctx,
 				   enum v4l2_buf_type type)
 {
 	switch (type) {
 	case V4L2_BUF_TYPE_VIDEO_OUTPUT:
+	case V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE:
 		return &ctx->src;
 	case V4L2_BUF_TYPE_VIDEO_CAPTURE:
+	case V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE:
 		return &ctx->dst;
 	default:
 		return ERR_PTR(-EINVAL);
 	}
 }
 
+/*
+ * Round the size of pix to whole chroma samples, and work out the line and
+ * image sizes of its planes. Formats with a single memory plane have the
+ * planes of the image laid out one after the other in it.
+ */
+static void g2d_pix_fmt_fill(struct v4l2_pix_format_mplane *pix,
+			     struct g2d_fmt *fmt, uint32_t alignment)
+{
+	uint32_t pitch[3], size[3];
+	uint32_t hsub, vsub;
+	int i;
+
+	fmt2subsampling(fmt->hw_id, &hsub, &vsub);
+	pix->width = ALIGN(pix->width, hsub);
+	pix->height = ALIGN(pix->height, vsub);
+
+	g2d_fmt_plane_sizes(fmt->hw_id, pix->width, pix->height, alignment,
+			pitch, size);
+
+	memset(pix->plane_fmt, 0, sizeof(pix->plane_fmt));
+	pix->num_planes = fmt->num_planes;
+
+	if (fmt->num_planes == 1) {
+		pix->plane_fmt[0].bytesperline = pitch[0];
+		pix->plane_fmt[0].sizeimage = size[0] + size[1] + size[2];
+		return;
+	}
+
+	for (i = 0; i < fmt->num_planes; i++) {
+		pix->plane_fmt[i].bytesperline = pitch[i];
+		pix->plane_fmt[i].sizeimage = size[i];
+	}
+}
+
+/*
+ * Whether op fetches the frame of the OUTPUT (output true) or CAPTURE queue
+ * through a UI layer, which only takes RGB formats
+ */
+static bool g2d_op_needs_rgb(enum g2d_op op, bool output)
+{
+	switch (op) {
+	case G2D_BLEND:
+	case G2D_FADE:
+	case G2D_COMPOSE:
+		return output;
+	case G2D_ROP:
+		/* the pattern is drawn by a UI layer set up like the destination */
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool g2d_frame_is_yuv(struct g2d_frame *frm)
+{
+	return g2d_fmt_is_yuv(find_fmt(&frm->v4l2_pix_fmt)->hw_id);
+}
+
+/*
+ * Whether op, not being tiled, draws the selection of the OUTPUT (output
+ * true) or CAPTURE queue in a single pass
+ */
+static bool g2d_op_single_pass(enum g2d_op op, bool output)
+{
+	switch (op) {
+	case G2D_ROTATE:
+	case G2D_ROP:
+	case G2D_CLEAR_BITBLT:
+		return true;
+	case G2D_MOVE:
+		/* only the capture compose rectangle is moved */
+		return !output;
+	default:
+		return false;
+	}
+}
+
+static bool g2d_fits_pass(struct sunxi_g2d_ctx *ctx, uint32_t width,
+			  uint32_t height)
+{
+	const struct g2d_variant *variant = ctx->g2d->variant;
+
+	return width <= variant->pass_width && height <= variant->pass_height;
+}
+
 /* Controls */
 
-static int g2d_s_ctrl(struct v4l2_ctrl *ctrl)
+static int g2d_ctrl_apply(struct sunxi_g2d_ctx *ctx, struct v4l2_ctrl *ctrl)
 {
-	struct sunxi_g2d_ctx *ctx = container_of(ctrl->handler,
-					      struct sunxi_g2d_ctx,
-					      ctrl_handler);
+	struct vb2_queue *vq;
+	uint32_t *p;
+	int i;
 
 	switch (ctrl->id) {
 	case V4L2_CID_SUNXI_G2D_OP_SELECT:
@@ -111,10 +506,25 @@ static int g2d_s_ctrl(struct v4l2_ctrl *ctrl)
 		ctx->dst.alpha_bld_mode = ctrl->val;
 		break;
 	case V4L2_CID_SUNXI_G2D_IN_ALIGNMENT:
+		/* the alignment changes the buffer layout, as s_fmt does */
+		vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx,
+				     V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE);
+		if (vb2_is_busy(vq))
+			return -EBUSY;
+
 		ctx->src.alignment = ctrl->val;
+		g2d_pix_fmt_fill(&ctx->src.v4l2_pix_fmt,
+				 find_fmt(&ctx->src.v4l2_pix_fmt), ctrl->val);
 		break;
 	case V4L2_CID_SUNXI_G2D_OUT_ALIGNMENT:
+		vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx,
+				     V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+		if (vb2_is_busy(vq))
+			return -EBUSY;
+
 		ctx->dst.alignment = ctrl->val;
+		g2d_pix_fmt_fill(&ctx->dst.v4l2_pix_fmt,
+				 find_fmt(&ctx->dst.v4l2_pix_fmt), ctrl->val);
 		break;
 	case V4L2_CID_SUNXI_G2D_RECTFILL_COLOR:
 		ctx->rectfill_color = ctrl->p_new.p_u32[0];
@@ -122,6 +532,72 @@ static int g2d_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_SUNXI_G2D_RECTFILL_COLOR_ALPHA:
 		ctx->rectfill_color_alpha = ctrl->p_new.p_u8[0];
 		break;
+	case V4L2_CID_SUNXI_G2D_RECTFILL_RECTS:
+		for (i = 0; i < G2D_RECTFILL_MAX_RECTS; i++) {
+			p = &ctrl->p_new.p_u32[i * 5];
+			ctx->fill_rects[i].r.left = p[0];
+			ctx->fill_rects[i].r.top = p[1];
+			ctx->fill_rects[i].r.width = p[2];
+			ctx->fill_rects[i].r.height = p[3];
+			ctx->fill_rects[i].color = p[4];
+		}
+		break;
+	case V4L2_CID_SUNXI_G2D_RECTFILL_NUM_RECTS:
+		ctx->fill_count = ctrl->val;
+		break;
+	case V4L2_CID_SUNXI_G2D_BLEND_MODE:
+		ctx->bld_mode = ctrl->val;
+		break;
+	case V4L2_CID_SUNXI_G2D_IN_GLOBAL_ALPHA:
+		ctx->src_global_alpha = ctrl->p_new.p_u8[0];
+		break;
+	case V4L2_CID_SUNXI_G2D_COLORKEY_MODE:
+		ctx->ckey_mode = ctrl->val;
+		break;
+	case V4L2_CID_SUNXI_G2D_COLORKEY_MIN:
+		/* master of the color key range cluster */
+		ctx->ckey_min = ctrl->cluster[0]->p_new.p_u32[0];
+		ctx->ckey_max = ctrl->cluster[1]->p_new.p_u32[0];
+		break;
+	case V4L2_CID_SUNXI_G2D_ROP_CODE:
+		ctx->rop_code = ctrl->p_new.p_u8[0];
+		break;
+	case V4L2_CID_SUNXI_G2D_ROP_PATTERN_COLOR:
+		ctx->rop_pattern_color = ctrl->p_new.p_u32[0];
+		break;
+	case V4L2_CID_SUNXI_G2D_COMPOSE_LAYERS:
+		for (i = 0; i < G2D_COMPOSE_MAX_LAYERS; i++) {
+			p = &ctrl->p_new.p_u32[i * 9];
+			ctx->layers[i].src.left = p[0];
+			ctx->layers[i].src.top = p[1];
+			ctx->layers[i].src.width = p[2];
+			ctx->layers[i].src.height = p[3];
+			ctx->layers[i].dst_left = p[4];
+			ctx->layers[i].dst_top = p[5];
+			ctx->layers[i].zpos = p[6];
+			ctx->layers[i].global_alpha = p[7];
+			ctx->layers[i].premult_alpha = p[8];
+		}
+		break;
+	case V4L2_CID_SUNXI_G2D_COMPOSE_NUM_LAYERS:
+		ctx->layer_count = ctrl->val;
+		break;
+	case V4L2_CID_SUNXI_G2D_FADE_ALPHA:
+		ctx->fade_alpha = ctrl->p_new.p_u8[0];
+		break;
+	case V4L2_CID_SUNXI_G2D_MOVE_OFFSET:
+		ctx->move_dx = ctrl->p_new.p_s32[0];
+		ctx->move_dy = ctrl->p_new.p_s32[1];
+		break;
+	case V4L2_CID_ROTATE:
+		ctx->rotation = ctrl->val;
+		break;
+	case V4L2_CID_HFLIP:
+		ctx->hflip = ctrl->val;
+		break;
+	case V4L2_CID_VFLIP:
+		ctx->vflip = ctrl->val;
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -129,14 +605,98 @@ static int g2d_s_ctrl(struct v4l2_ctrl *ctrl)
 	return 0;
 }
 
+static int g2d_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct sunxi_g2d_ctx *ctx = container_of(ctrl->handler,
+					      struct sunxi_g2d_ctx,
+					      ctrl_handler);
+	unsigned long flags;
+	int ret;
+
+	/* a job starting meanwhile copies the settings before or after */
+	spin_lock_irqsave(&ctx->lock, flags);
+	ret = g2d_ctrl_apply(ctx, ctrl);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	return ret;
+}
+
 static int g2d_try_ctrl(struct v4l2_ctrl *ctrl)
 {
+	struct sunxi_g2d_ctx *ctx = container_of(ctrl->handler,
+					      struct sunxi_g2d_ctx,
+					      ctrl_handler);
+	struct v4l2_pix_format_mplane *pix = &ctx->dst.v4l2_pix_fmt;
+	struct v4l2_pix_format_mplane *src_pix = &ctx->src.v4l2_pix_fmt;
+	uint32_t min, max;
+	uint32_t *p;
+	int i;
+
 	if (ctrl->id == V4L2_CID_SUNXI_G2D_IN_ALIGNMENT || 
 		ctrl->id == V4L2_CID_SUNXI_G2D_OUT_ALIGNMENT) {
 		if ((ctrl->val) & (ctrl->val - 1)) /* must be power of 2 */
 			return -EINVAL;
 	}
 
+	/* the op must be able to fetch and draw the current selections */
+	if (ctrl->id == V4L2_CID_SUNXI_G2D_OP_SELECT) {
+		if ((g2d_op_needs_rgb(ctrl->val, true) &&
+		     g2d_frame_is_yuv(&ctx->src)) ||
+		    (g2d_op_needs_rgb(ctrl->val, false) &&
+		     g2d_frame_is_yuv(&ctx->dst)))
+			return -EINVAL;
+
+		if ((g2d_op_single_pass(ctrl->val, true) &&
+		     !g2d_fits_pass(ctx, ctx->src.sel.r.width,
+				    ctx->src.sel.r.height)) ||
+		    (g2d_op_single_pass(ctrl->val, false) &&
+		     !g2d_fits_pass(ctx, ctx->dst.sel.r.width,
+				    ctx->dst.sel.r.height)))
+			return -EINVAL;
+	}
+
+	/* the color key range must not be inverted on any channel */
+	if (ctrl->id == V4L2_CID_SUNXI_G2D_COLORKEY_MIN) {
+		min = ctrl->cluster[0]->p_new.p_u32[0];
+		max = ctrl->cluster[1]->p_new.p_u32[0];
+		for (i = 0; i < 24; i += 8)
+			if (((min >> i) & 0xff) > ((max >> i) & 0xff))
+				return -EINVAL;
+	}
+
+	/*
+	 * every rectangle must lie within the capture frame and be filled in
+	 * a single pass
+	 */
+	if (ctrl->id == V4L2_CID_SUNXI_G2D_RECTFILL_RECTS) {
+		for (i = 0; i < G2D_RECTFILL_MAX_RECTS; i++) {
+			p = &ctrl->p_new.p_u32[i * 5];
+			if ((p[0] > pix->width) || (p[2] > pix->width - p[0]) ||
+				(p[1] > pix->height) || (p[3] > pix->height - p[1]) ||
+				!g2d_fits_pass(ctx, p[2], p[3]))
+				return -EINVAL;
+		}
+	}
+
+	/*
+	 * every layer must be taken from within the output frame, land
+	 * within the capture frame and be drawn in a single pass
+	 */
+	if (ctrl->id == V4L2_CID_SUNXI_G2D_COMPOSE_LAYERS) {
+		for (i = 0; i < G2D_COMPOSE_MAX_LAYERS; i++) {
+			p = &ctrl->p_new.p_u32[i * 9];
+			if ((p[0] > src_pix->width) ||
+				(p[2] > src_pix->width - p[0]) ||
+				(p[1] > src_pix->height) ||
+				(p[3] > src_pix->height - p[1]) ||
+				(p[4] > pix->width) || (p[2] > pix->width - p[4]) ||
+				(p[5] > pix->height) || (p[3] > pix->height - p[5]) ||
+				!g2d_fits_pass(ctx, p[2], p[3]) ||
+				(p[7] > 0xff) || (p[8] > 1))
+				return -EINVAL;
+		}
+	}
+
 	return 0;
 }
 
@@ -148,6 +708,33 @@ static const struct v4l2_ctrl_ops g2d_ctrl_ops = {
 static const char * const g2d_op_menu[] = {
 	"Rectfill",
 	"Bitblit",
+	"Blend",
+	"Scale",
+	"Rotate",
+	"Raster Operation",
+	"Convert",
+	"Compose",
+	"Clear",
+	"Clear and Bitblit",
+	"Premultiply",
+	"Fade",
+	"Move",
+	NULL,
+};
+
+static const char * const g2d_blend_mode_menu[] = {
+	"Clear",
+	"Src",
+	"Dst",
+	"Src Over",
+	"Dst Over",
+	"Src In",
+	"Dst In",
+	"Src Out",
+	"Dst Out",
+	"Src Atop",
+	"Dst Atop",
+	"Xor",
 	NULL,
 };
 
@@ -158,6 +745,13 @@ static const char * const g2d_alpha_mode_menu[] = {
 	NULL,
 };
 
+static const char * const g2d_colorkey_mode_menu[] = {
+	"Disabled",
+	"Source",
+	"Destination",
+	NULL,
+};
+
 static const struct v4l2_ctrl_config g2d_ctrls[] = {
 	{
 		.ops = &g2d_ctrl_ops,
@@ -165,7 +759,7 @@ static const struct v4l2_ctrl_config g2d_ctrls[] = {
 		.type = V4L2_CTRL_TYPE_MENU,
 		.name = "G2D Operation",
 		.min = 0,
-		.max = 1,
+		.max = ARRAY_SIZE(g2d_op_menu) - 2,
 		.def = 0,
 		.qmenu = g2d_op_menu,
 	},
@@ -213,24 +807,170 @@ static const struct v4l2_ctrl_config g2d_ctrls[] = {
 		.ops = &g2d_ctrl_ops,
 		.id = V4L2_CID_SUNXI_G2D_RECTFILL_COLOR,
 		.type = V4L2_CTRL_TYPE_U32,
-		.name = "G2D Rectfill Color",
+		.name = "G2D Rectfill Color",
+		.min = 0,
+		.max = 0xffffffff,
+		.def = DEF_RECTFILL_COLOR,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_RECTFILL_COLOR_ALPHA,
+		.type = V4L2_CTRL_TYPE_U8,
+		.name = "G2D Rectfill Color Alpha",
+		.min = 0,
+		.max = 0xff,
+		.def = DEF_RECTFILL_COLOR_ALPHA,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_RECTFILL_RECTS,
+		.type = V4L2_CTRL_TYPE_U32,
+		.name = "G2D Rectfill Rects",
+		.min = 0,
+		.max = 0xffffffff,
+		.def = 0,
+		.step = 1,
+		/* left, top, width, height and color of each rectangle */
+		.dims = { G2D_RECTFILL_MAX_RECTS, 5 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_RECTFILL_NUM_RECTS,
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name = "G2D Rectfill Num Rects",
+		.min = 0,
+		.max = G2D_RECTFILL_MAX_RECTS,
+		.def = 0, /* fill the compose selection with the rectfill color */
+		.step = 1,
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_BLEND_MODE,
+		.type = V4L2_CTRL_TYPE_MENU,
+		.name = "G2D Blend Mode",
+		.min = 0,
+		.max = ARRAY_SIZE(g2d_blend_mode_menu) - 2,
+		.def = DEF_BLEND_MODE,
+		.qmenu = g2d_blend_mode_menu,
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_IN_GLOBAL_ALPHA,
+		.type = V4L2_CTRL_TYPE_U8,
+		.name = "G2D Input Global Alpha",
+		.min = 0,
+		.max = 0xff,
+		.def = DEF_GLOBAL_ALPHA,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_COLORKEY_MODE,
+		.type = V4L2_CTRL_TYPE_MENU,
+		.name = "G2D Color Key Mode",
+		.min = 0,
+		.max = ARRAY_SIZE(g2d_colorkey_mode_menu) - 2,
+		.def = G2D_CKEY_NONE,
+		.qmenu = g2d_colorkey_mode_menu,
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_COLORKEY_MIN,
+		.type = V4L2_CTRL_TYPE_U32,
+		.name = "G2D Color Key Min",
+		.min = 0,
+		.max = 0xffffff,
+		.def = DEF_COLORKEY,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_COLORKEY_MAX,
+		.type = V4L2_CTRL_TYPE_U32,
+		.name = "G2D Color Key Max",
+		.min = 0,
+		.max = 0xffffff,
+		.def = DEF_COLORKEY,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_ROP_CODE,
+		.type = V4L2_CTRL_TYPE_U8,
+		.name = "G2D ROP3 Code",
+		.min = 0,
+		.max = 0xff,
+		.def = DEF_ROP_CODE,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_ROP_PATTERN_COLOR,
+		.type = V4L2_CTRL_TYPE_U32,
+		.name = "G2D ROP Pattern Color",
+		.min = 0,
+		.max = 0xffffffff,
+		.def = DEF_ROP_PATTERN_COLOR,
+		.step = 1,
+		.dims = { 1 },
+	},
+	{
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_COMPOSE_LAYERS,
+		.type = V4L2_CTRL_TYPE_U32,
+		.name = "G2D Compose Layers",
 		.min = 0,
 		.max = 0xffffffff,
-		.def = DEF_RECTFILL_COLOR,
+		.def = 0,
 		.step = 1,
-		.dims = { 1 },
+		/*
+		 * source left, top, width and height, destination left and top,
+		 * zpos, global alpha and premultiplied flag of each layer
+		 */
+		.dims = { G2D_COMPOSE_MAX_LAYERS, 9 },
 	},
 	{
 		.ops = &g2d_ctrl_ops,
-		.id = V4L2_CID_SUNXI_G2D_RECTFILL_COLOR_ALPHA,
+		.id = V4L2_CID_SUNXI_G2D_COMPOSE_NUM_LAYERS,
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name = "G2D Compose Num Layers",
+		.min = 1,
+		.max = G2D_COMPOSE_MAX_LAYERS,
+		.def = DEF_COMPOSE_NUM_LAYERS,
+		.step = 1,
+	},
+	{
+		/* weight of the source in the fade, 0xff leaving only it */
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_FADE_ALPHA,
 		.type = V4L2_CTRL_TYPE_U8,
-		.name = "G2D Rectfill Color Alpha",
+		.name = "G2D Fade Alpha",
 		.min = 0,
 		.max = 0xff,
-		.def = DEF_RECTFILL_COLOR_ALPHA,
+		.def = DEF_FADE_ALPHA,
 		.step = 1,
 		.dims = { 1 },
 	},
+	{
+		/* x and y shift of the capture compose rectangle */
+		.ops = &g2d_ctrl_ops,
+		.id = V4L2_CID_SUNXI_G2D_MOVE_OFFSET,
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name = "G2D Move Offset",
+		.min = -(int32_t)G2D_MAX_WIDTH,
+		.max = G2D_MAX_WIDTH,
+		.def = 0,
+		.step = 1,
+		.dims = { 2 },
+	},
 };
 
 #define NUM_CTRLS ARRAY_SIZE(g2d_ctrls)
@@ -241,6 +981,8 @@ static int g2d_job_ready(void *priv)
 
 	switch (ctx->chosen_g2d_op) {
 	case G2D_RECTFILL:
+	case G2D_CLEAR:
+	case G2D_MOVE:
 		/*
 		 * In reality Rectfill requires no source buffer and only a single
 		 * destination buffer and its selection to use as the fill rectangle
@@ -257,12 +999,326 @@ static int g2d_job_ready(void *priv)
 	return 1;
 } 
 
+/*
+ * The capture frame may have been resized since the rectangles were set,
+ * so skip those that are empty or no longer fit
+ */
+static bool g2d_fill_rect_fits(struct g2d_job *job, struct g2d_fill_rect *rect)
+{
+	struct v4l2_pix_format_mplane *dst = &job->dst.v4l2_pix_fmt;
+	struct v4l2_rect *r = &rect->r;
+
+	if (!r->width || !r->height)
+		return false;
+
+	return (r->left + r->width <= dst->width) &&
+		(r->top + r->height <= dst->height);
+}
+
+/*
+ * Fill the next rectangles of the list that fit a single pass. Returns
+ * false once none is left.
+ */
+static bool g2d_rectfill_list_run(struct g2d_job *job)
+{
+	struct g2d_fill_rect *rects;
+	unsigned int n, count;
+
+	while (job->fill_next < job->fill_count &&
+	       !g2d_fill_rect_fits(job, &job->fill_rects[job->fill_next]))
+		job->fill_next++;
+
+	if (job->fill_next >= job->fill_count)
+		return false;
+
+	/* only the run of usable rectangles that follows can be packed */
+	rects = &job->fill_rects[job->fill_next];
+	for (count = 1; job->fill_next + count < job->fill_count; count++)
+		if (!g2d_fill_rect_fits(job, &rects[count]))
+			break;
+
+	n = g2d_rectfill_pack(job->g2d->variant, rects, count);
+	g2d_rectfill_multi(job, job->dst_addr, rects, n);
+	job->fill_next += n;
+
+	return true;
+}
+
+/* Stack the layers from the lowest zpos up, equal ones in control order */
+static void g2d_compose_sort(struct g2d_job *job)
+{
+	unsigned int *order = job->layer_order;
+	unsigned int i, j, tmp;
+
+	for (i = 0; i < job->layer_count; i++) {
+		order[i] = i;
+		for (j = i; j > 0; j--) {
+			if (job->layers[order[j - 1]].zpos <=
+				job->layers[order[j]].zpos)
+				break;
+
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+}
+
+/*
+ * The frames may have been resized since the layers were set, so skip
+ * those that are empty or no longer fit
+ */
+static bool g2d_compose_layer_fits(struct g2d_job *job,
+				   struct g2d_compose_layer *layer)
+{
+	struct v4l2_pix_format_mplane *src = &job->src.v4l2_pix_fmt;
+	struct v4l2_pix_format_mplane *dst = &job->dst.v4l2_pix_fmt;
+	struct v4l2_rect *r = &layer->src;
+
+	if (!r->width || !r->height)
+		return false;
+
+	return (r->left + r->width <= src->width) &&
+		(r->top + r->height <= src->height) &&
+		(layer->dst_left + r->width <= dst->width) &&
+		(layer->dst_top + r->height <= dst->height);
+}
+
+/*
+ * Work out the area of the destination a tileable op draws. Returns false
+ * for the other ops, which always run in a single pass.
+ */
+static bool g2d_op_area(struct g2d_job *job, struct v4l2_rect *area)
+{
+	switch (job->op) {
+	case G2D_RECTFILL:
+		/* rectangle lists are batched instead */
+		if (job->fill_count)
+			return false;
+		fallthrough;
+	case G2D_CLEAR:
+	case G2D_BLEND:
+	case G2D_FADE:
+	case G2D_SCALE:
+		*area = job->dst.sel.r;
+		return true;
+	case G2D_BITBLT:
+		area->left = job->dst.sel.r.left;
+		area->top = job->dst.sel.r.top;
+		area->width = min(job->src.sel.r.width, job->dst.sel.r.width);
+		area->height = min(job->src.sel.r.height,
+				job->dst.sel.r.height);
+		return true;
+	case G2D_CONVERT:
+	case G2D_PREMULTIPLY:
+		area->left = 0;
+		area->top = 0;
+		area->width = min(job->src.v4l2_pix_fmt.width,
+				job->dst.v4l2_pix_fmt.width);
+		area->height = min(job->src.v4l2_pix_fmt.height,
+				job->dst.v4l2_pix_fmt.height);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Split the area the op draws in a grid of tiles the hardware can handle in
+ * one pass. Returns false if the op is not tiled.
+ */
+static bool g2d_tile_setup(struct g2d_job *job)
+{
+	const struct g2d_variant *variant = job->g2d->variant;
+	struct v4l2_rect *area = &job->tile_area;
+
+	job->tile_count = 0;
+	job->tile_next = 0;
+
+	if (!g2d_op_area(job, area))
+		return false;
+
+	job->tile_count = DIV_ROUND_UP(area->width, variant->pass_width) *
+			DIV_ROUND_UP(area->height, variant->pass_height);
+
+	return true;
+}
+
+/* draw the next tile of the op, the grid being walked row by row */
+static void g2d_tile_run(struct g2d_job *job)
+{
+	struct v4l2_rect *area = &job->tile_area;
+	struct v4l2_rect *tile = &job->tile;
+	const struct g2d_variant *variant = job->g2d->variant;
+	unsigned int cols = DIV_ROUND_UP(area->width, variant->pass_width);
+	unsigned int x = (job->tile_next % cols) * variant->pass_width;
+	unsigned int y = (job->tile_next / cols) * variant->pass_height;
+
+	tile->left = area->left + x;
+	tile->top = area->top + y;
+	tile->width = min(area->width - x, variant->pass_width);
+	tile->height = min(area->height - y, variant->pass_height);
+	job->tile_next++;
+
+	switch (job->op) {
+	case G2D_RECTFILL:
+		g2d_rectfill(job, job->dst_addr);
+		break;
+	case G2D_CLEAR:
+		g2d_clear(job, job->dst_addr);
+		break;
+	case G2D_BITBLT:
+		g2d_bitblt(job, job->src_addr, job->dst_addr);
+		break;
+	case G2D_BLEND:
+		/* the destination is both blended with and written to */
+		g2d_blend(job, job->src_addr, job->dst_addr);
+		break;
+	case G2D_FADE:
+		/* the destination is both an operand and the result */
+		g2d_fade(job, job->src_addr, job->dst_addr);
+		break;
+	case G2D_CONVERT:
+		g2d_convert(job, job->src_addr, job->dst_addr);
+		break;
+	case G2D_PREMULTIPLY:
+		g2d_premultiply(job, job->src_addr, job->dst_addr);
+		break;
+	case G2D_SCALE:
+		g2d_scale(job, job->src_addr, job->dst_addr);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Start the next hardware pass of the running job, if any. Returns false
+ * once the job is complete.
+ */
+static bool g2d_job_next_pass(struct g2d_job *job)
+{
+	struct g2d_compose_layer *layer;
+
+	if (job->tile_next < job->tile_count) {
+		g2d_tile_run(job);
+		return true;
+	}
+
+	switch (job->op) {
+	case G2D_RECTFILL:
+		return g2d_rectfill_list_run(job);
+	case G2D_COMPOSE:
+		while (job->layer_next < job->layer_count) {
+			layer = &job->layers[job->layer_order[job->layer_next++]];
+			if (!g2d_compose_layer_fits(job, layer))
+				continue;
+
+			g2d_compose_layer(job, job->src_addr,
+					job->dst_addr, layer);
+			return true;
+		}
+
+		return false;
+	default:
+		return false;
+	}
+}
+
+/* Copy the settings the passes of a job use, see struct g2d_job */
+static void g2d_job_copy(struct sunxi_g2d_ctx *ctx)
+{
+	struct g2d_job *job = &ctx->job;
+	unsigned long flags;
+
+	job->g2d = ctx->g2d;
+
+	spin_lock_irqsave(&ctx->lock, flags);
+
+	job->op = ctx->chosen_g2d_op;
+	job->src = ctx->src;
+	job->dst = ctx->dst;
+
+	job->rectfill_color = ctx->rectfill_color;
+	job->rectfill_color_alpha = ctx->rectfill_color_alpha;
+	job->fill_count = ctx->fill_count;
+	memcpy(job->fill_rects, ctx->fill_rects,
+	       job->fill_count * sizeof(*job->fill_rects));
+
+	job->src_compose = ctx->src_compose;
+	job->bld_mode = ctx->bld_mode;
+	job->src_global_alpha = ctx->src_global_alpha;
+	job->ckey_mode = ctx->ckey_mode;
+	job->ckey_min = ctx->ckey_min;
+	job->ckey_max = ctx->ckey_max;
+
+	job->rop_code = ctx->rop_code;
+	job->rop_pattern_color = ctx->rop_pattern_color;
+
+	job->layer_count = ctx->layer_count;
+	memcpy(job->layers, ctx->layers,
+	       job->layer_count * sizeof(*job->layers));
+
+	job->fade_alpha = ctx->fade_alpha;
+	job->move_dx = ctx->move_dx;
+	job->move_dy = ctx->move_dy;
+
+	job->rotation = ctx->rotation;
+	job->hflip = ctx->hflip;
+	job->vflip = ctx->vflip;
+
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	job->fill_next = 0;
+	job->layer_next = 0;
+}
+
+/* Hand the buffers of the running job back in state */
+static void g2d_job_done(struct sunxi_g2d_ctx *ctx,
+			 enum vb2_buffer_state state)
+{
+	struct vb2_v4l2_buffer *src, *dst;
+
+	src = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+	dst = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+
+	v4l2_m2m_buf_done(src, state);
+	v4l2_m2m_buf_done(dst, state);
+	v4l2_m2m_job_finish(ctx->g2d->m2m_dev, ctx->fh.m2m_ctx);
+}
+
+/*
+ * Formats with a single memory plane hold the planes of the image one after
+ * the other, as laid out by g2d_pix_fmt_fill()
+ */
+static void g2d_buf_addrs(struct g2d_frame *frm, struct vb2_v4l2_buffer *buf,
+			  dma_addr_t addr[3])
+{
+	struct g2d_fmt *fmt = find_fmt(&frm->v4l2_pix_fmt);
+	uint32_t pitch[3], size[3];
+	int i;
+
+	if (fmt->num_planes > 1) {
+		for (i = 0; i < 3; i++)
+			addr[i] = (i < fmt->num_planes) ?
+				vb2_dma_contig_plane_dma_addr(&buf->vb2_buf, i) : 0;
+		return;
+	}
+
+	g2d_fmt_plane_sizes(fmt->hw_id, frm->v4l2_pix_fmt.width,
+			frm->v4l2_pix_fmt.height, frm->alignment, pitch, size);
+
+	addr[0] = vb2_dma_contig_plane_dma_addr(&buf->vb2_buf, 0);
+	addr[1] = (size[1]) ? addr[0] + size[0] : 0;
+	addr[2] = (size[2]) ? addr[1] + size[1] : 0;
+}
+
 static void g2d_device_run(void *priv)
 {
 	struct sunxi_g2d_ctx *ctx = priv;
 	struct sunxi_g2d *g2d = ctx->g2d;
+	struct g2d_job *job = &ctx->job;
 	struct vb2_v4l2_buffer *src, *dst;
-	dma_addr_t src_addr, dst_addr, addr[3];
 
 	dev_info(g2d->dev, "In g2d_device_run");
 
@@ -271,20 +1327,78 @@ static void g2d_device_run(void *priv)
 
 	v4l2_m2m_buf_copy_metadata(src, dst, true);
 
-	src_addr = vb2_dma_contig_plane_dma_addr(&src->vb2_buf, 0);
-	dst_addr = vb2_dma_contig_plane_dma_addr(&dst->vb2_buf, 0);
+	/* from here on, the passes only use the copy of the settings */
+	g2d_job_copy(ctx);
 
-	switch (ctx->chosen_g2d_op) {
+	g2d_buf_addrs(&job->src, src, job->src_addr);
+	g2d_buf_addrs(&job->dst, dst, job->dst_addr);
+
+	/* the tiled ops draw a tile per pass */
+	if (g2d_tile_setup(job)) {
+		if (!g2d_job_next_pass(job))
+			g2d_job_done(ctx, VB2_BUF_STATE_DONE);
+		return;
+	}
+
+	/* s_fmt may have reset a selection to a frame larger than a pass */
+	if ((g2d_op_single_pass(job->op, true) &&
+	     !g2d_fits_pass(ctx, job->src.sel.r.width, job->src.sel.r.height)) ||
+	    (g2d_op_single_pass(job->op, false) &&
+	     !g2d_fits_pass(ctx, job->dst.sel.r.width, job->dst.sel.r.height))) {
+		v4l2_err(&g2d->v4l2_dev,
+			 "The operation can't draw more than %ux%u\n",
+			 g2d->variant->pass_width, g2d->variant->pass_height);
+		g2d_job_done(ctx, VB2_BUF_STATE_ERROR);
+		return;
+	}
+
+	switch (job->op) {
 	case G2D_RECTFILL:
 		/*
 		* The rectfill op only requires a destination addr for the
-		* result, since it works 'in place'
+		* result, since it works 'in place'. A single rectangle is
+		* tiled, a list of them is batched.
 		*/
-		addr[0] = dst_addr;
-		addr[1] = 0;
-		addr[2] = 0;
-		g2d_rectfill(ctx, addr);
+		if (!g2d_rectfill_list_run(job))
+			g2d_job_done(ctx, VB2_BUF_STATE_DONE);
+		break;
+
+	case G2D_ROTATE:
+		/* the rotator doesn't convert, it writes in the source format */
+		if (job->src.v4l2_pix_fmt.pixelformat !=
+		    job->dst.v4l2_pix_fmt.pixelformat) {
+			v4l2_err(&g2d->v4l2_dev,
+				 "Rotation needs the same format on both queues\n");
+			g2d_job_done(ctx, VB2_BUF_STATE_ERROR);
+			break;
+		}
+
+		g2d_rotate(job, job->src_addr, job->dst_addr);
+		break;
+
+	case G2D_ROP:
+		/* the destination is both an operand and the result */
+		g2d_rop(job, job->src_addr, job->dst_addr);
+		break;
+
+	case G2D_COMPOSE:
+		/* the layers are drawn over what the destination holds */
+		g2d_compose_sort(job);
+
+		/* nothing to draw if no layer fits */
+		if (!g2d_job_next_pass(job))
+			g2d_job_done(ctx, VB2_BUF_STATE_DONE);
+
+		break;
+
+	case G2D_CLEAR_BITBLT:
+		g2d_clear_blit(job, job->src_addr, job->dst_addr);
+		break;
 
+	case G2D_MOVE:
+		/* the pixels are moved within the destination buffer */
+		if (!g2d_move(job, job->dst_addr))
+			g2d_job_done(ctx, VB2_BUF_STATE_DONE);
 		break;
 
 	default:
@@ -296,7 +1410,6 @@ irqreturn_t g2d_irq(int irq, void *data)
 {
 	struct sunxi_g2d *g2d = data;
 	struct sunxi_g2d_ctx *ctx;
-	struct vb2_v4l2_buffer *src, *dst;
 
 	ctx = v4l2_m2m_get_curr_priv(g2d->m2m_dev);
 	if (!ctx) {
@@ -305,17 +1418,15 @@ irqreturn_t g2d_irq(int irq, void *data)
 		return IRQ_NONE;
 	}
 
-	if (!g2d_mixer_irq_query(g2d))
+	if (g2d_mixer_irq_query(g2d))
+		g2d_mixer_reset(g2d);
+	else if (g2d->variant->has_rotator && g2d_rot_irq_query(g2d))
+		g2d_rot_reset(g2d);
+	else
 		return IRQ_NONE;
 
-	g2d_mixer_reset(g2d);
-
-	src = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
-	dst = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
-
-	v4l2_m2m_buf_done(src, VB2_BUF_STATE_DONE);
-	v4l2_m2m_buf_done(dst, VB2_BUF_STATE_DONE);
-	v4l2_m2m_job_finish(g2d->m2m_dev, ctx->fh.m2m_ctx);
+	if (!g2d_job_next_pass(&ctx->job))
+		g2d_job_done(ctx, VB2_BUF_STATE_DONE);
 
 	return IRQ_HANDLED;
 }
@@ -333,13 +1444,35 @@ static int g2d_querycap(struct file *file, void *priv,
 	return 0;
 }
 
+/* Whether fmt can be used in direction dir on this SoC */
+static bool g2d_fmt_usable(const struct sunxi_g2d *g2d,
+		const struct g2d_fmt *fmt, uint32_t dir)
+{
+	if (!(fmt->flags & dir))
+		return false;
+
+	if ((fmt->flags & G2D_FMT_10BIT) && !g2d->variant->has_10bit)
+		return false;
+
+	return true;
+}
+
 static int g2d_enum_fmt(struct file *file, void *priv,
 				struct v4l2_fmtdesc *f)
 {
-	if (f->index < NUM_SUPPORTED_FMTS) {
-		f->pixelformat = g2d_supported_fmts[f->index].fourcc;
+	struct sunxi_g2d_ctx *ctx = g2d_file2ctx(file);
+	uint32_t dir = V4L2_TYPE_IS_OUTPUT(f->type) ? G2D_FMT_SRC : G2D_FMT_DST;
+	unsigned int i, num = 0;
 
-		return 0;
+	for (i = 0; i < NUM_SUPPORTED_FMTS; i++) {
+		if (!g2d_fmt_usable(ctx->g2d, &g2d_supported_fmts[i], dir))
+			continue;
+
+		if (num++ == f->index) {
+			f->pixelformat = g2d_supported_fmts[i].fourcc;
+
+			return 0;
+		}
 	}
 
 	return -EINVAL;
@@ -355,7 +1488,7 @@ static int g2d_g_fmt(struct file *file, void *priv,
 	if (IS_ERR(frm))
 		return PTR_ERR(frm);
 
-	f->fmt.pix = frm->v4l2_pix_fmt;
+	f->fmt.pix_mp = frm->v4l2_pix_fmt;
 
 	return 0;
 }
@@ -363,21 +1496,28 @@ static int g2d_g_fmt(struct file *file, void *priv,
 static int g2d_try_fmt(struct file *file, void *priv,
 				       struct v4l2_format *f)
 {
+	struct sunxi_g2d_ctx *ctx = g2d_file2ctx(file);
+	const struct g2d_variant *variant = ctx->g2d->variant;
+	uint32_t dir = V4L2_TYPE_IS_OUTPUT(f->type) ? G2D_FMT_SRC : G2D_FMT_DST;
+	struct g2d_frame *frm;
 	struct g2d_fmt *fmt;
-	uint32_t width = f->fmt.pix.width;
-	uint32_t height = f->fmt.pix.height;
 
-	fmt = find_fmt(&f->fmt.pix);
-	if (!fmt)
-		f->fmt.pix.pixelformat = g2d_supported_fmts[0].fourcc;
+	frm = get_frame(ctx, f->type);
+	if (IS_ERR(frm))
+		return PTR_ERR(frm);
 
-	width = clamp(width, G2D_MIN_WIDTH, G2D_MAX_WIDTH);
-	height = clamp(height, G2D_MIN_HEIGHT, G2D_MAX_HEIGHT);
+	fmt = find_fmt(&f->fmt.pix_mp);
+	if (!fmt || !g2d_fmt_usable(ctx->g2d, fmt, dir)) {
+		fmt = &g2d_supported_fmts[0];
+		f->fmt.pix_mp.pixelformat = fmt->fourcc;
+	}
 
-	f->fmt.pix.width = width;
-	f->fmt.pix.height = height;
-	f->fmt.pix.bytesperline = (f->fmt.pix.width * fmt->depth) >> 3;
-	f->fmt.pix.sizeimage = f->fmt.pix.height * f->fmt.pix.bytesperline;
+	f->fmt.pix_mp.width = clamp(f->fmt.pix_mp.width, G2D_MIN_WIDTH,
+				variant->max_width);
+	f->fmt.pix_mp.height = clamp(f->fmt.pix_mp.height, G2D_MIN_HEIGHT,
+				variant->max_height);
+	f->fmt.pix_mp.field = V4L2_FIELD_NONE;
+	g2d_pix_fmt_fill(&f->fmt.pix_mp, fmt, frm->alignment);
 
 	return 0;
 }
@@ -401,8 +1541,58 @@ static int g2d_s_fmt(struct file *file, void *priv, struct v4l2_format *f)
 	if (vb2_is_busy(vq))
 		return -EBUSY;
 
-	frm->v4l2_pix_fmt = f->fmt.pix;
-	frm->premult_alpha = (f->fmt.pix.flags & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA);
+	/* the selected op may fetch this frame through a UI layer */
+	if (g2d_fmt_is_yuv(find_fmt(&f->fmt.pix_mp)->hw_id) &&
+	    g2d_op_needs_rgb(ctx->chosen_g2d_op, V4L2_TYPE_IS_OUTPUT(f->type)))
+		return -EINVAL;
+
+	frm->v4l2_pix_fmt = f->fmt.pix_mp;
+	frm->premult_alpha = (f->fmt.pix_mp.flags & V4L2_PIX_FMT_FLAG_PREMUL_ALPHA);
+
+	/* fall back to the whole frame if the selection no longer fits */
+	if ((frm->sel.r.left + frm->sel.r.width > f->fmt.pix_mp.width) ||
+		(frm->sel.r.top + frm->sel.r.height > f->fmt.pix_mp.height)) {
+		frm->sel.r.left = 0;
+		frm->sel.r.top = 0;
+		frm->sel.r.width = f->fmt.pix_mp.width;
+		frm->sel.r.height = f->fmt.pix_mp.height;
+
+		if (V4L2_TYPE_IS_OUTPUT(f->type)) {
+			ctx->src_compose.width = frm->sel.r.width;
+			ctx->src_compose.height = frm->sel.r.height;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The OUTPUT compose selection places the source crop within the capture
+ * compose rectangle when blending. The blend op scales the crop to its size,
+ * it defaults to the size of the crop.
+ */
+static int g2d_g_src_compose(struct sunxi_g2d_ctx *ctx,
+			     struct v4l2_selection *sel)
+{
+	switch (sel->target) {
+	case V4L2_SEL_TGT_COMPOSE:
+		sel->r = ctx->src_compose;
+		break;
+	case V4L2_SEL_TGT_COMPOSE_DEFAULT:
+		sel->r.left = 0;
+		sel->r.top = 0;
+		sel->r.width = ctx->src.sel.r.width;
+		sel->r.height = ctx->src.sel.r.height;
+		break;
+	case V4L2_SEL_TGT_COMPOSE_BOUNDS:
+		sel->r.left = 0;
+		sel->r.top = 0;
+		sel->r.width = ctx->dst.sel.r.width;
+		sel->r.height = ctx->dst.sel.r.height;
+		break;
+	default:
+		return -EINVAL;
+	}
 
 	return 0;
 }
@@ -427,8 +1617,8 @@ static int g2d_g_selection(struct file *file, void *priv,
 	case V4L2_SEL_TGT_COMPOSE:
 	case V4L2_SEL_TGT_COMPOSE_DEFAULT:
 	case V4L2_SEL_TGT_COMPOSE_BOUNDS:
-		if (!V4L2_TYPE_IS_CAPTURE(sel->type))
-			return -EINVAL;
+		if (V4L2_TYPE_IS_OUTPUT(sel->type))
+			return g2d_g_src_compose(ctx, sel);
 		break;
 	default:
 		return -EINVAL;
@@ -472,7 +1662,8 @@ static int g2d_try_selection(struct file *file, void *priv,
 		if (sel->target != V4L2_SEL_TGT_COMPOSE)
 			return -EINVAL;
 	} else if (V4L2_TYPE_IS_OUTPUT(sel->type)) {
-		if (sel->target != V4L2_SEL_TGT_CROP)
+		if (sel->target != V4L2_SEL_TGT_CROP &&
+			sel->target != V4L2_SEL_TGT_COMPOSE)
 			return -EINVAL;
 	}
 
@@ -482,14 +1673,45 @@ static int g2d_try_selection(struct file *file, void *priv,
 		return -EINVAL;
 	}
 
+	/* the source must start within the capture compose rectangle */
+	if (V4L2_TYPE_IS_OUTPUT(sel->type) &&
+		sel->target == V4L2_SEL_TGT_COMPOSE) {
+		if ((sel->r.left > ctx->dst.sel.r.width - 1) ||
+			(sel->r.top > ctx->dst.sel.r.height - 1))
+			return -EINVAL;
+
+		if (sel->r.width > ctx->g2d->variant->max_width ||
+			sel->r.height > ctx->g2d->variant->max_height)
+			return -EINVAL;
+
+		/* a size scales the source crop to it through the GSU */
+		if (sel->r.width && sel->r.height &&
+			(ctx->src.sel.r.width >=
+			 G2D_GSU_MAX_DOWNSCALE * sel->r.width ||
+			 ctx->src.sel.r.height >=
+			 G2D_GSU_MAX_DOWNSCALE * sel->r.height))
+			return -EINVAL;
+
+		return 0;
+	}
+
+	/* the ops have nothing to read or write in an empty rectangle */
+	if (!sel->r.width || !sel->r.height)
+		return -EINVAL;
+
+	if (g2d_op_single_pass(ctx->chosen_g2d_op,
+			       V4L2_TYPE_IS_OUTPUT(sel->type)) &&
+		!g2d_fits_pass(ctx, sel->r.width, sel->r.height))
+		return -EINVAL;
+
 	if ((sel->r.left > frm->v4l2_pix_fmt.width - 1) ||
 		(sel->r.top > frm->v4l2_pix_fmt.height - 1))
 		return -EINVAL;
 	
-	if ((sel->r.left + sel->r.width) > (frm->v4l2_pix_fmt.width - 1))
+	if ((sel->r.left + sel->r.width) > frm->v4l2_pix_fmt.width)
 		return -EINVAL;
 
-	if ((sel->r.top + sel->r.height) > (frm->v4l2_pix_fmt.height - 1))
+	if ((sel->r.top + sel->r.height) > frm->v4l2_pix_fmt.height)
 		return -EINVAL;
 
 	return 0;
@@ -500,6 +1722,7 @@ static int g2d_s_selection(struct file *file, void *priv,
 {
 	struct sunxi_g2d_ctx *ctx = g2d_file2ctx(file);
 	struct g2d_frame *frm;
+	unsigned long flags;
 	int ret;
 
 	ret = g2d_try_selection(file, priv, sel);
@@ -510,11 +1733,34 @@ static int g2d_s_selection(struct file *file, void *priv,
 	if (IS_ERR(frm))
 		return PTR_ERR(frm);
 
+	/* a job starting meanwhile copies the selections before or after */
+	spin_lock_irqsave(&ctx->lock, flags);
+
+	if (V4L2_TYPE_IS_OUTPUT(sel->type) &&
+		sel->target == V4L2_SEL_TGT_COMPOSE) {
+		/* an empty size keeps the source unscaled */
+		if (!sel->r.width || !sel->r.height) {
+			sel->r.width = ctx->src.sel.r.width;
+			sel->r.height = ctx->src.sel.r.height;
+		}
+		ctx->src_compose = sel->r;
+		goto out;
+	}
+
 	frm->sel.r.width = sel->r.width;
 	frm->sel.r.height	= sel->r.height;
 	frm->sel.r.left	= sel->r.left;
 	frm->sel.r.top	= sel->r.top;
 
+	/* a new source crop is drawn unscaled until composed again */
+	if (V4L2_TYPE_IS_OUTPUT(sel->type)) {
+		ctx->src_compose.width = sel->r.width;
+		ctx->src_compose.height = sel->r.height;
+	}
+
+out:
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
 	return 0;
 }
 
@@ -522,14 +1768,14 @@ static const struct v4l2_ioctl_ops g2d_ioctl_ops = {
 	.vidioc_querycap		= g2d_querycap,
 
 	.vidioc_enum_fmt_vid_cap	= g2d_enum_fmt,
-	.vidioc_g_fmt_vid_cap		= g2d_g_fmt,
-	.vidioc_try_fmt_vid_cap		= g2d_try_fmt,
-	.vidioc_s_fmt_vid_cap		= g2d_s_fmt,
+	.vidioc_g_fmt_vid_cap_mplane	= g2d_g_fmt,
+	.vidioc_try_fmt_vid_cap_mplane	= g2d_try_fmt,
+	.vidioc_s_fmt_vid_cap_mplane	= g2d_s_fmt,
 
 	.vidioc_enum_fmt_vid_out	= g2d_enum_fmt,
-	.vidioc_g_fmt_vid_out		= g2d_g_fmt,
-	.vidioc_try_fmt_vid_out		= g2d_try_fmt,
-	.vidioc_s_fmt_vid_out		= g2d_s_fmt,
+	.vidioc_g_fmt_vid_out_mplane	= g2d_g_fmt,
+	.vidioc_try_fmt_vid_out_mplane	= g2d_try_fmt,
+	.vidioc_s_fmt_vid_out_mplane	= g2d_s_fmt,
 
 	.vidioc_reqbufs			= v4l2_m2m_ioctl_reqbufs,
 	.vidioc_querybuf		= v4l2_m2m_ioctl_querybuf,
@@ -554,17 +1800,23 @@ static int g2d_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers,
 {
 	struct sunxi_g2d_ctx *ctx = vb2_get_drv_priv(vq);
 	struct g2d_frame *frm;
+	unsigned int i;
 
 	frm = get_frame(ctx, vq->type);
 	if (IS_ERR(frm))
 		return PTR_ERR(frm);
 
 	if (*nplanes) {
-		if (sizes[0] < frm->v4l2_pix_fmt.sizeimage)
+		if (*nplanes != frm->v4l2_pix_fmt.num_planes)
 			return -EINVAL;
+
+		for (i = 0; i < *nplanes; i++)
+			if (sizes[i] < frm->v4l2_pix_fmt.plane_fmt[i].sizeimage)
+				return -EINVAL;
 	} else {
-		sizes[0] = frm->v4l2_pix_fmt.sizeimage;
-		*nplanes = 1;
+		*nplanes = frm->v4l2_pix_fmt.num_planes;
+		for (i = 0; i < *nplanes; i++)
+			sizes[i] = frm->v4l2_pix_fmt.plane_fmt[i].sizeimage;
 	}
 
 	return 0;
@@ -575,14 +1827,19 @@ static int g2d_buf_prepare(struct vb2_buffer *vb)
 	struct vb2_queue *vq = vb->vb2_queue;
 	struct sunxi_g2d_ctx *ctx = vb2_get_drv_priv(vq);
 	struct g2d_frame *frm;
+	unsigned int i;
 
 	frm = get_frame(ctx, vq->type);
 	if (IS_ERR(frm))
 		return PTR_ERR(frm);
-	if (vb2_plane_size(vb, 0) < frm->v4l2_pix_fmt.sizeimage)
-		return -EINVAL;
 
-	vb2_set_plane_payload(vb, 0, frm->v4l2_pix_fmt.sizeimage);
+	for (i = 0; i < frm->v4l2_pix_fmt.num_planes; i++) {
+		if (vb2_plane_size(vb, i) < frm->v4l2_pix_fmt.plane_fmt[i].sizeimage)
+			return -EINVAL;
+
+		vb2_set_plane_payload(vb, i,
+				frm->v4l2_pix_fmt.plane_fmt[i].sizeimage);
+	}
 
 	return 0;
 }
@@ -657,7 +1914,7 @@ static int g2d_queue_init(void *priv, struct vb2_queue *src_vq,
 	struct sunxi_g2d_ctx *ctx = priv;
 	int ret;
 
-	src_vq->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	src_vq->type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
 	src_vq->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
 	src_vq->drv_priv = ctx;
 	src_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
@@ -672,7 +1929,7 @@ static int g2d_queue_init(void *priv, struct vb2_queue *src_vq,
 	if (ret)
 		return ret;
 
-	dst_vq->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	dst_vq->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 	dst_vq->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
 	dst_vq->drv_priv = ctx;
 	dst_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
@@ -696,14 +1953,36 @@ static int g2d_setup_ctrls(struct sunxi_g2d_ctx *ctx)
 	struct v4l2_ctrl *ctrl;
 	int i;
 
-	v4l2_ctrl_handler_init(&ctx->ctrl_handler, NUM_CTRLS);
+	v4l2_ctrl_handler_init(&ctx->ctrl_handler, NUM_CTRLS + 3);
 
 	ctx->g2d->v4l2_dev.ctrl_handler = &ctx->ctrl_handler;
 
 	for (i = 0; i < NUM_CTRLS; ++i) {
-		ctrl = v4l2_ctrl_new_custom(&ctx->ctrl_handler, &g2d_ctrls[i], NULL);
+		struct v4l2_ctrl_config cfg = g2d_ctrls[i];
+
+		/* Don't offer the rotation op on a G2D without the rotator */
+		if (cfg.id == V4L2_CID_SUNXI_G2D_OP_SELECT &&
+		    !g2d->variant->has_rotator)
+			cfg.menu_skip_mask |= BIT(G2D_ROTATE);
+
+		ctrl = v4l2_ctrl_new_custom(&ctx->ctrl_handler, &cfg, NULL);
+		if (cfg.id == V4L2_CID_SUNXI_G2D_COLORKEY_MIN)
+			ctx->ckey_range[0] = ctrl;
+		else if (cfg.id == V4L2_CID_SUNXI_G2D_COLORKEY_MAX)
+			ctx->ckey_range[1] = ctrl;
 	}
 
+	/* the color key bounds are set and checked together */
+	v4l2_ctrl_cluster(2, ctx->ckey_range);
+
+	/* Rotate ctrls */
+	v4l2_ctrl_new_std(&ctx->ctrl_handler, &g2d_ctrl_ops,
+			  V4L2_CID_ROTATE, 0, 270, 90, 0);
+	v4l2_ctrl_new_std(&ctx->ctrl_handler, &g2d_ctrl_ops,
+			  V4L2_CID_HFLIP, 0, 1, 1, 0);
+	v4l2_ctrl_new_std(&ctx->ctrl_handler, &g2d_ctrl_ops,
+			  V4L2_CID_VFLIP, 0, 1, 1, 0);
+
 	if (ctx->ctrl_handler.error) {
 		int err = ctx->ctrl_handler.error;
 		v4l2_err(&g2d->v4l2_dev, "g2d_setup_ctrls failed\n");
@@ -729,6 +2008,8 @@ static int g2d_open(struct file *file)
 		return -ENOMEM;
 	}
 
+	spin_lock_init(&ctx->lock);
+
 	/* default output format */
 	ctx->src.v4l2_pix_fmt.pixelformat = V4L2_PIX_FMT_XBGR32;
 	ctx->src.v4l2_pix_fmt.field = V4L2_FIELD_NONE;
@@ -737,11 +2018,16 @@ static int g2d_open(struct file *file)
 	ctx->src.premult_alpha = true;
 	ctx->src.alpha_bld_mode = G2D_PIXEL_ALPHA;
 	ctx->src.alignment = 1;
+	g2d_pix_fmt_fill(&ctx->src.v4l2_pix_fmt,
+			 find_fmt(&ctx->src.v4l2_pix_fmt), ctx->src.alignment);
 	ctx->src.sel.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	ctx->src.sel.r.width = DEF_IMG_W;
+	ctx->src.sel.r.height = DEF_IMG_H;
+	ctx->src_compose = ctx->src.sel.r;
 
 	/* default capture format */
 	ctx->dst = ctx->src;
-	ctx->src.sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	ctx->dst.sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
 	/** TODO: Remove this!!! Only used for testing rectfill operation
 	 *  without usersapce 
@@ -817,7 +2103,7 @@ static const struct video_device g2d_videodev = {
 	.ioctl_ops	= &g2d_ioctl_ops,
 	.minor		= -1,
 	.release	= video_device_release_empty,
-	.device_caps	= V4L2_CAP_VIDEO_M2M | V4L2_CAP_STREAMING,
+	.device_caps	= V4L2_CAP_VIDEO_M2M_MPLANE | V4L2_CAP_STREAMING,
 };
 
 static const struct v4l2_m2m_ops g2d_m2m_ops = {
@@ -838,6 +2124,17 @@ static int g2d_probe(struct platform_device *pdev)
 	g2d->vfd = g2d_videodev;
 	g2d->dev = &pdev->dev;
 
+	g2d->variant = of_device_get_match_data(&pdev->dev);
+	if (!g2d->variant)
+		return -EINVAL;
+
+	ret = dma_set_mask_and_coherent(g2d->dev,
+			DMA_BIT_MASK(g2d->variant->addr_40bit ? 40 : 32));
+	if (ret) {
+		dev_err(g2d->dev, "Failed to set the DMA mask\n");
+		return ret;
+	}
+
 	irq = platform_get_irq(pdev, 0);
 	if (irq < 0)
 		return irq;
@@ -852,6 +2149,7 @@ static int g2d_probe(struct platform_device *pdev)
 	g2d->base = devm_platform_ioremap_resource(pdev, 0);
 	if (IS_ERR(g2d->base))
 		return PTR_ERR(g2d->base);
+	g2d->reg_ops = &g2d_mmio_reg_ops;
 
 	g2d->bus_clk = devm_clk_get(g2d->dev, "bus");
 	if (IS_ERR(g2d->bus_clk)) {
@@ -954,13 +2252,13 @@ static int sunxi_g2d_runtime_resume(struct device *device)
 	}
 
 	/*
-	 * This 300MHz value is gotten from the BSP and is absolutely necessary
-     * for the g2d block to not hang (i.e never issuing an interrupt after
-     * completing an operation).
-	 * TODO: try other closer rates to pin down [min, max] of the 
-     * functional range. 
+	 * The rate comes from the BSP of each SoC and is absolutely necessary
+	 * for the g2d block to not hang (i.e never issuing an interrupt after
+	 * completing an operation).
+	 * TODO: try other closer rates to pin down [min, max] of the
+	 * functional range.
 	 */
-	ret = clk_set_rate_exclusive(g2d->mod_clk, 300000000);
+	ret = clk_set_rate_exclusive(g2d->mod_clk, g2d->variant->mod_rate);
 	if (ret) {
 		dev_err(g2d->dev, "Failed to set exclusive mod clock rate\n");
 		goto err_reset_assert;
@@ -1017,8 +2315,88 @@ static int sunxi_g2d_runtime_suspend(struct device *device)
 	return 0;
 }
 
+/*
+ * Frames are only bounded by the size fields. The generic compatible keeps
+ * the settings the driver always used: 2048x2048 per pass, every format,
+ * 32-bit addresses and the 300MHz module clock of the vendor BSP, without
+ * which the block may hang and never raise its interrupt.
+ */
+static const struct g2d_variant sunxi_g2d_variant = {
+	.max_width = G2D_MAX_WIDTH,
+	.max_height = G2D_MAX_HEIGHT,
+	.pass_width = 2048,
+	.pass_height = 2048,
+	.has_rotator = true,
+	.has_10bit = true,
+	.addr_40bit = false,
+	.mod_rate = 300000000,
+};
+
+static const struct g2d_variant sun8i_h3_g2d_variant = {
+	.max_width = 2048,
+	.max_height = 2048,
+	.pass_width = 2048,
+	.pass_height = 2048,
+	.has_rotator = false,
+	.has_10bit = false,
+	.addr_40bit = false,
+	.mod_rate = 300000000,
+};
+
+static const struct g2d_variant sun20i_t113_g2d_variant = {
+	.max_width = G2D_MAX_WIDTH,
+	.max_height = G2D_MAX_HEIGHT,
+	.pass_width = 2048,
+	.pass_height = 2048,
+	.has_rotator = true,
+	.has_10bit = false,
+	.addr_40bit = false,
+	.mod_rate = 300000000,
+};
+
+static const struct g2d_variant sun50i_h6_g2d_variant = {
+	.max_width = G2D_MAX_WIDTH,
+	.max_height = G2D_MAX_HEIGHT,
+	.pass_width = 4096,
+	.pass_height = 4096,
+	.has_rotator = true,
+	.has_10bit = true,
+	.addr_40bit = true,
+	.mod_rate = 432000000,
+};
+
+static const struct g2d_variant sun50i_h616_g2d_variant = {
+	.max_width = G2D_MAX_WIDTH,
+	.max_height = G2D_MAX_HEIGHT,
+	.pass_width = 4096,
+	.pass_height = 4096,
+	.has_rotator = true,
+	.has_10bit = true,
+	.addr_40bit = true,
+	.mod_rate = 432000000,
+};
+
 static const struct of_device_id sunxi_g2d_match[] = {
-	{ .compatible = "allwinner,sunxi-g2d" },
+	{
+		.compatible = "allwinner,sunxi-g2d",
+		.data = &sunxi_g2d_variant,
+	},
+	{
+		.compatible = "allwinner,sun8i-h3-g2d",
+		.data = &sun8i_h3_g2d_variant,
+	},
+	{
+		.compatible = "allwinner,sun20i-t113-g2d",
+		.data = &sun20i_t113_g2d_variant,
+	},
+	{
+		.compatible = "allwinner,sun50i-h6-g2d",
+		.data = &sun50i_h6_g2d_variant,
+	},
+	{
+		.compatible = "allwinner,sun50i-h616-g2d",
+		.data = &sun50i_h616_g2d_variant,
+	},
 	{},
 };
 MODULE_DEVICE_TABLE(of, sunxi_g2d_match);
@@ -20,14 +20,66 @@
 
 #define G2D_NAME "sunxi-g2d"
 
+/* 10-bit fourccs missing from older kernel headers */
+#ifndef V4L2_PIX_FMT_ARGB2101010
+#define V4L2_PIX_FMT_ARGB2101010	v4l2_fourcc('A', 'R', '3', '0')
+#endif
+#ifndef V4L2_PIX_FMT_RGBA1010102
+#define V4L2_PIX_FMT_RGBA1010102	v4l2_fourcc('R', 'A', '3', '0')
+#endif
+#ifndef V4L2_PIX_FMT_P010
+#define V4L2_PIX_FMT_P010		v4l2_fourcc('P', '0', '1', '0')
+#endif
+
 #define G2D_MIN_WIDTH	8U
 #define G2D_MIN_HEIGHT	8U
-#define G2D_MAX_WIDTH	2048U
-#define G2D_MAX_HEIGHT	2048U
+
+/* The size fields of the layer and write-back registers are 13 bits wide */
+#define G2D_MAX_WIDTH	8192U
+#define G2D_MAX_HEIGHT	8192U
+
+/* The GSU step has 4 integer bits, so it shrinks by less than 16 times */
+#define G2D_GSU_MAX_DOWNSCALE	16U
+
+/* Size of the rectfill rectangle list */
+#define G2D_RECTFILL_MAX_RECTS	64
+
+/* Number of layers the compose op stacks on the destination */
+#define G2D_COMPOSE_MAX_LAYERS	4
 
 enum g2d_op {
 	G2D_RECTFILL,
-	G2D_BITBLT
+	G2D_BITBLT,
+	G2D_BLEND,
+	G2D_SCALE,
+	G2D_ROTATE,
+	G2D_ROP,
+	G2D_CONVERT,
+	G2D_COMPOSE,
+	G2D_CLEAR,
+	G2D_CLEAR_BITBLT,
+	G2D_PREMULTIPLY,
+	G2D_FADE,
+	G2D_MOVE,
+};
+
+/*
+ * Porter-Duff rules used to blend the source (OUTPUT) layer with the
+ * destination (CAPTURE) layer
+ */
+enum g2d_porter_duff {
+	G2D_BLD_CLEAR,
+	G2D_BLD_SRC,
+	G2D_BLD_DST,
+	G2D_BLD_SRC_OVER,
+	G2D_BLD_DST_OVER,
+	G2D_BLD_SRC_IN,
+	G2D_BLD_DST_IN,
+	G2D_BLD_SRC_OUT,
+	G2D_BLD_DST_OUT,
+	G2D_BLD_SRC_ATOP,
+	G2D_BLD_DST_ATOP,
+	G2D_BLD_XOR,
 };
 
 /*
@@ -43,21 +95,89 @@ enum g2d_alpha_bld_mode {
 	G2D_MIXER_ALPHA,
 };
 
+/*
+ * Color keying of blend operations
+ * G2D_CKEY_SRC: source pixels within the key range are not drawn
+ * G2D_CKEY_DST: source pixels are only drawn where the destination
+ * is within the key range
+ */
+enum g2d_ckey_mode {
+	G2D_CKEY_NONE,
+	G2D_CKEY_SRC,
+	G2D_CKEY_DST,
+};
+
+/* g2d_fmt flags */
+#define G2D_FMT_SRC	BIT(0)	/* can be fetched by the video layer */
+#define G2D_FMT_DST	BIT(1)	/* can be written back */
+#define G2D_FMT_10BIT	BIT(2)	/* only on a G2D taking 10-bit formats */
+
 struct g2d_fmt {
 	u32	fourcc;
 	int depth;
 	u32 hw_id;
+	u32 flags;
+	u8 num_planes;	/* memory planes, each one in its own buffer */
+};
+
+struct g2d_fill_rect {
+	struct v4l2_rect r;
+	uint32_t color;
+};
+
+/*
+ * A compose layer is the src rectangle of the source frame, drawn at
+ * (dst_left, dst_top) in the destination frame. Layers are stacked from the
+ * lowest zpos up.
+ */
+struct g2d_compose_layer {
+	struct v4l2_rect src;
+	uint32_t dst_left;
+	uint32_t dst_top;
+	uint32_t zpos;
+	uint32_t global_alpha;
+	bool premult_alpha;
 };
 
 struct g2d_frame {
-	struct v4l2_pix_format v4l2_pix_fmt;
+	struct v4l2_pix_format_mplane v4l2_pix_fmt;
 	bool premult_alpha;
 	enum g2d_alpha_bld_mode alpha_bld_mode;
 	uint32_t alignment;
 	struct v4l2_selection sel;
 };
 
+/* Capabilities of the G2D of a given SoC */
+struct g2d_variant {
+	/* largest frame, at most G2D_MAX_WIDTH x G2D_MAX_HEIGHT */
+	uint32_t max_width;
+	uint32_t max_height;
+	/* largest area drawn in a single pass, bigger ops are split in tiles */
+	uint32_t pass_width;
+	uint32_t pass_height;
+	bool has_rotator;
+	/* takes the 10-bit formats */
+	bool has_10bit;
+	/* the layers, write-back and rotator take 40-bit bus addresses */
+	bool addr_40bit;
+	/* module clock rate the block is known to run reliably at */
+	unsigned long mod_rate;
+};
+
+struct sunxi_g2d;
+
+/*
+ * Register accessors. The driver goes through g2d_mmio_reg_ops, the tests
+ * swap in a fake register file.
+ */
+struct g2d_reg_ops {
+	uint32_t (*read)(struct sunxi_g2d *g2d, uint32_t reg);
+	void (*write)(struct sunxi_g2d *g2d, uint32_t reg, uint32_t val);
+};
+
 struct sunxi_g2d {
+	const struct g2d_variant *variant;
+	const struct g2d_reg_ops *reg_ops;
 	void __iomem	*base;
 	int irq;
 	struct clk *mod_clk;
@@ -76,6 +196,64 @@ struct sunxi_g2d {
 	struct g2d_fmt *supported_fmts;
 };
 
+/*
+ * State of the running job. The passes after the first one are started
+ * from the interrupt handler, so they work from copies of the settings
+ * taken when the job starts, which userspace can't change under them.
+ */
+struct g2d_job {
+	struct sunxi_g2d *g2d;
+	enum g2d_op op;
+
+	struct g2d_frame src;
+	struct g2d_frame dst;
+	dma_addr_t src_addr[3];
+	dma_addr_t dst_addr[3];
+
+	/* output area of a tiled op and the tile of the current pass */
+	struct v4l2_rect tile_area;
+	struct v4l2_rect tile;
+	unsigned int tile_count;
+	unsigned int tile_next;
+
+	/* only useful for rectfill operations */
+	uint32_t rectfill_color;
+	uint32_t rectfill_color_alpha;
+	struct g2d_fill_rect fill_rects[G2D_RECTFILL_MAX_RECTS];
+	unsigned int fill_count;
+	unsigned int fill_next;
+
+	/* only useful for blend operations */
+	struct v4l2_rect src_compose;
+	enum g2d_porter_duff bld_mode;
+	uint32_t src_global_alpha;
+	enum g2d_ckey_mode ckey_mode;
+	uint32_t ckey_min;
+	uint32_t ckey_max;
+
+	/* only useful for raster operations */
+	uint32_t rop_code;
+	uint32_t rop_pattern_color;
+
+	/* only useful for compose operations */
+	struct g2d_compose_layer layers[G2D_COMPOSE_MAX_LAYERS];
+	unsigned int layer_count;
+	unsigned int layer_order[G2D_COMPOSE_MAX_LAYERS];
+	unsigned int layer_next;
+
+	/* only useful for fade operations */
+	uint32_t fade_alpha;
+
+	/* only useful for move operations */
+	int32_t move_dx;
+	int32_t move_dy;
+
+	/* only useful for rotate operations */
+	uint32_t rotation;
+	bool hflip;
+	bool vflip;
+};
+
 struct sunxi_g2d_ctx {
 	struct v4l2_fh		fh;
 	struct sunxi_g2d	*g2d;
@@ -86,13 +264,51 @@ struct sunxi_g2d_ctx {
 	/* only useful for rectfill operations */
 	uint32_t rectfill_color;
 	uint32_t rectfill_color_alpha;
+	struct g2d_fill_rect fill_rects[G2D_RECTFILL_MAX_RECTS];
+	unsigned int fill_count;
+
+	/* only useful for blend operations */
+	struct v4l2_rect src_compose;	/* source position in the dst compose */
+	enum g2d_porter_duff bld_mode;
+	uint32_t src_global_alpha;
+	enum g2d_ckey_mode ckey_mode;
+	uint32_t ckey_min;
+	uint32_t ckey_max;
+	struct v4l2_ctrl *ckey_range[2];	/* min and max, clustered */
+
+	/* only useful for raster operations */
+	uint32_t rop_code;
+	uint32_t rop_pattern_color;
+
+	/* only useful for compose operations */
+	struct g2d_compose_layer layers[G2D_COMPOSE_MAX_LAYERS];
+	unsigned int layer_count;
+
+	/* only useful for fade operations */
+	uint32_t fade_alpha;
+
+	/* only useful for move operations */
+	int32_t move_dx;
+	int32_t move_dy;
+
+	/* only useful for rotate operations */
+	uint32_t rotation;
+	bool hflip;
+	bool vflip;
 	
 	/* active g2d operation */
 	enum g2d_op chosen_g2d_op;
 
+	/*
+	 * held while the settings are changed or copied into job, but by
+	 * s_fmt, which only runs with no buffer allocated, hence no job
+	 */
+	spinlock_t lock;
+	struct g2d_job job;
+
 	struct v4l2_ctrl_handler ctrl_handler;
 };
 
-struct g2d_fmt *find_fmt(struct v4l2_pix_format *);
+struct g2d_fmt *find_fmt(struct v4l2_pix_format_mplane *);
 
 #endif
\ No newline at end of file
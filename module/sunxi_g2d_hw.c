@@ -12,49 +12,69 @@
 #include <linux/stddef.h>
 #include <linux/dmaengine.h>
 #include <linux/bitfield.h>
+#include <linux/math64.h>
 
 #include "sunxi_g2d_hw.h"
 #include "sunxi_g2d_regs.h"
 
-static inline uint32_t g2d_read(struct sunxi_g2d *g2d, uint32_t reg)
+static uint32_t g2d_mmio_read(struct sunxi_g2d *g2d, uint32_t reg)
 {
 	return readl(g2d->base + reg);
 }
 
+static void g2d_mmio_write(struct sunxi_g2d *g2d, uint32_t reg, uint32_t val)
+{
+	writel(val, g2d->base + reg);
+}
+
+const struct g2d_reg_ops g2d_mmio_reg_ops = {
+	.read = g2d_mmio_read,
+	.write = g2d_mmio_write,
+};
+
+static inline uint32_t g2d_read(struct sunxi_g2d *g2d, uint32_t reg)
+{
+	return g2d->reg_ops->read(g2d, reg);
+}
+
 static inline void g2d_write(struct sunxi_g2d *g2d,
 				     uint32_t reg, uint32_t val)
 {
-	writel(val, g2d->base + reg);
+	g2d->reg_ops->write(g2d, reg, val);
 }
 
 static inline void g2d_set_bits(struct sunxi_g2d *g2d,
 					uint32_t reg, uint32_t bits)
 {
-	writel(readl(g2d->base + reg) | bits, g2d->base + reg);
+	g2d_write(g2d, reg, g2d_read(g2d, reg) | bits);
 }
 
 static inline void g2d_clr_bits(struct sunxi_g2d *g2d,
 					    uint32_t reg, uint32_t bits)
 {
-	writel(readl(g2d->base + reg) & ~bits, g2d->base + reg);
+	g2d_write(g2d, reg, g2d_read(g2d, reg) & ~bits);
 }
 
-static uint32_t v4l2_fmt_to_hw_id(struct v4l2_pix_format *v4l2_pix_fmt)
+static uint32_t v4l2_fmt_to_hw_id(struct v4l2_pix_format_mplane *v4l2_pix_fmt)
 {
 	struct g2d_fmt *fmt;
 
-	fmt = find_fmt(v4l2_pix_fmt); // !! (rectfill assumption) src_fmt
-	return (fmt) ? fmt->hw_id : G2D_FORMAT_BGRX8888;
+	fmt = find_fmt(v4l2_pix_fmt);
+	return (fmt) ? fmt->hw_id : G2D_FORMAT_XRGB8888;
 }
 
 void g2d_hw_open(struct sunxi_g2d *g2d)
 {
-	g2d_set_bits(g2d, G2D_SCLK_GATE,
-			(G2D_SCLK_GATE_MIXER | G2D_SCLK_GATE_ROT));
-	g2d_set_bits(g2d, G2D_HCLK_GATE,
-			(G2D_HCLK_GATE_MIXER | G2D_HCLK_GATE_ROT));
-	g2d_set_bits(g2d, G2D_AHB_RESET, 
-			(G2D_AHB_MIXER_RESET | G2D_AHB_ROT_RESET));
+	g2d_set_bits(g2d, G2D_SCLK_GATE, G2D_SCLK_GATE_MIXER);
+	g2d_set_bits(g2d, G2D_HCLK_GATE, G2D_HCLK_GATE_MIXER);
+	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_MIXER_RESET);
+
+	if (!g2d->variant->has_rotator)
+		return;
+
+	g2d_set_bits(g2d, G2D_SCLK_GATE, G2D_SCLK_GATE_ROT);
+	g2d_set_bits(g2d, G2D_HCLK_GATE, G2D_HCLK_GATE_ROT);
+	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_ROT_RESET);
 }
 
 void g2d_hw_close(struct sunxi_g2d *g2d)
@@ -67,8 +87,11 @@ void g2d_hw_close(struct sunxi_g2d *g2d)
 void g2d_hw_reset(struct sunxi_g2d *g2d)
 {
 	g2d_write(g2d, G2D_AHB_RESET, 0);
-	g2d_set_bits(g2d, G2D_AHB_RESET, 
-			(G2D_AHB_MIXER_RESET | G2D_AHB_ROT_RESET));
+	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_MIXER_RESET);
+
+	/* the rotator is held in reset on the SoCs lacking it, as on open */
+	if (g2d->variant->has_rotator)
+		g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_ROT_RESET);
 }
 
 static void g2d_mixer_irq_enable(struct sunxi_g2d *g2d)
@@ -97,10 +120,33 @@ void g2d_mixer_reset(struct sunxi_g2d *g2d)
 	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_MIXER_RESET);
 }
 
+static void g2d_rot_irq_enable(struct sunxi_g2d *g2d)
+{
+	g2d_write(g2d, ROT_INT, ROT_INT_FINISH_IRQ_EN);
+}
+
+int g2d_rot_irq_query(struct sunxi_g2d *g2d)
+{
+	uint32_t tmp;
+
+	tmp = g2d_read(g2d, ROT_INT);
+	if (tmp & ROT_INT_IRQ_PENDING) {
+		/* the pending bit is write 1 to clear */
+		g2d_write(g2d, ROT_INT, ROT_INT_IRQ_PENDING);
+
+		return 1;
+	}
+
+	return 0;
+}
+
 void g2d_rot_reset(struct sunxi_g2d *g2d)
 {
-	g2d_clr_bits(g2d, G2D_AHB_RESET, G2D_AHB_MIXER_RESET);
-	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_MIXER_RESET);
+	if (!g2d->variant->has_rotator)
+		return;
+
+	g2d_clr_bits(g2d, G2D_AHB_RESET, G2D_AHB_ROT_RESET);
+	g2d_set_bits(g2d, G2D_AHB_RESET, G2D_AHB_ROT_RESET);
 }
 
 /*
@@ -176,34 +222,147 @@ void fmt2yuvcnt(uint32_t format, uint32_t *ycnt, uint32_t *ucnt, uint32_t *vcnt)
 		*ycnt = 6;
 }
 
-/* TODO: convert layer_no to an enumeration */
-void g2d_fc_set(struct sunxi_g2d *g2d, uint32_t layer_no, uint32_t color_value)
+/* horizontal and vertical chroma subsampling factors of a format */
+void fmt2subsampling(uint32_t format, uint32_t *hsub, uint32_t *vsub)
+{
+	*hsub = 1;
+	*vsub = 1;
+
+	if ((format >= G2D_FORMAT_IYUV422_V0Y1U0Y0)
+	      && (format <= G2D_FORMAT_YUV422_PLANAR))
+		*hsub = 2;
+
+	else if ((format >= G2D_FORMAT_YUV420UVC_V1U1V0U0)
+		 && (format <= G2D_FORMAT_YUV420_PLANAR)) {
+		*hsub = 2;
+		*vsub = 2;
+	}
+
+	else if ((format >= G2D_FORMAT_YUV411UVC_V1U1V0U0)
+		 && (format <= G2D_FORMAT_YUV411_PLANAR))
+		*hsub = 4;
+
+	else if (format == G2D_FORMAT_YVU10_P010) {
+		*hsub = 2;
+		*vsub = 2;
+	}
+
+	else if (format == G2D_FORMAT_YVU10_P210)
+		*hsub = 2;
+}
+
+/*
+ * Pitch and size of each plane of a width x height image in fmt_hw_id, with
+ * every line padded to alignment bytes
+ */
+void g2d_fmt_plane_sizes(uint32_t fmt_hw_id, uint32_t width, uint32_t height,
+		uint32_t alignment, uint32_t pitch[3], uint32_t size[3])
+{
+	uint32_t ycnt, ucnt, vcnt;
+	uint32_t hsub, vsub;
+	uint32_t cw, ch;
+
+	fmt2yuvcnt(fmt_hw_id, &ycnt, &ucnt, &vcnt);
+	fmt2subsampling(fmt_hw_id, &hsub, &vsub);
+
+	cw = DIV_ROUND_UP(width, hsub);
+	ch = DIV_ROUND_UP(height, vsub);
+
+	pitch[0] = ALIGN(ycnt * width, alignment);
+	pitch[1] = ALIGN(ucnt * cw, alignment);
+	pitch[2] = ALIGN(vcnt * cw, alignment);
+
+	size[0] = pitch[0] * height;
+	size[1] = pitch[1] * ch;
+	size[2] = pitch[2] * ch;
+}
+
+/*
+ * Work out the pitch of each plane of frm, and the address of the top left
+ * pixel of r in each of them
+ */
+static void g2d_frame_planes(struct g2d_frame *frm, struct v4l2_rect *r,
+		dma_addr_t addr[3], uint32_t pitch[3], dma_addr_t plane_addr[3])
+{
+	uint32_t fmt_hw_id;
+	uint32_t ycnt, ucnt, vcnt;
+	uint32_t hsub, vsub;
+	uint32_t size[3];
+	uint32_t cx, cy;
+
+	fmt_hw_id = v4l2_fmt_to_hw_id(&frm->v4l2_pix_fmt);
+	fmt2yuvcnt(fmt_hw_id, &ycnt, &ucnt, &vcnt);
+	fmt2subsampling(fmt_hw_id, &hsub, &vsub);
+	g2d_fmt_plane_sizes(fmt_hw_id, frm->v4l2_pix_fmt.width,
+			frm->v4l2_pix_fmt.height, frm->alignment, pitch, size);
+
+	cx = r->left / hsub;
+	cy = r->top / vsub;
+
+	plane_addr[0] = addr[0] + pitch[0] * r->top + ycnt * r->left;
+	plane_addr[1] = addr[1] + pitch[1] * cy + ucnt * cx;
+	plane_addr[2] = addr[2] + pitch[2] * cy + vcnt * cx;
+}
+
+/*
+ * Restrict out, a rectangle of the output, to the tile of the current pass.
+ * in, when given, is the rectangle of another frame mapped 1:1 on out and is
+ * cut alike. Tiles are cut from the area the op draws, so they always meet
+ * it. The layers and the write-back then start from the top left pixel of
+ * the tile, see g2d_frame_planes().
+ */
+static void g2d_tile_clip(struct g2d_job *job, struct v4l2_rect *out,
+		struct v4l2_rect *in)
+{
+	const struct v4l2_rect *t = &job->tile;
+	int32_t l = max(out->left, t->left);
+	int32_t u = max(out->top, t->top);
+	int32_t r = min(out->left + (int32_t)out->width,
+			t->left + (int32_t)t->width);
+	int32_t b = min(out->top + (int32_t)out->height,
+			t->top + (int32_t)t->height);
+
+	if (in) {
+		in->left += l - out->left;
+		in->top += u - out->top;
+		in->width = r - l;
+		in->height = b - u;
+	}
+
+	out->left = l;
+	out->top = u;
+	out->width = r - l;
+	out->height = b - u;
+}
+
+void g2d_fc_set(struct sunxi_g2d *g2d, enum g2d_layer layer_no,
+		uint32_t color_value)
 {
 	G2D_INFO_MSG("FILLCOLOR: sel: %d, color: 0x%x\n", layer_no, color_value);
 
 	switch (layer_no) 
 	{
-		case 0:
+		case G2D_LAYER_V0:
 			/* Video Layer */
 			g2d_set_bits(g2d, V0_ATTCTL, V0_ATTCTL_FILLCOLOR_EN);
 			g2d_write(g2d, V0_FILLC, color_value);
 			break;
 
-		case 1:
+		case G2D_LAYER_UI0:
 			/* UI0 Layer */
-			g2d_set_bits(g2d, UI0_ATTR, BIT(4));
+			g2d_set_bits(g2d, UI0_ATTR, UI_ATTR_FILLCOLOR_EN);
 			g2d_write(g2d, UI0_FILLC, color_value);
 			break;
 
-		case 2:
+		case G2D_LAYER_UI1:
 			/* UI1 Layer */
-			g2d_set_bits(g2d, UI1_ATTR, BIT(4));
+			g2d_set_bits(g2d, UI1_ATTR, UI_ATTR_FILLCOLOR_EN);
 			g2d_write(g2d, UI1_FILLC, color_value);
 			break;
 
-		case 3:
+		case G2D_LAYER_UI2:
 			/* UI2 Layer */
-			g2d_set_bits(g2d, UI2_ATTR, BIT(4));
+			g2d_set_bits(g2d, UI2_ATTR, UI_ATTR_FILLCOLOR_EN);
 			g2d_write(g2d, UI2_FILLC, color_value);
 			break;
 
@@ -212,9 +371,9 @@ void g2d_fc_set(struct sunxi_g2d *g2d, uint32_t layer_no, uint32_t color_value)
 	}
 }
 
-/* TODO: convert pipe_no to an enumeration */
+/* feed pipe_no with the selection of frm, placed at (x, y) in the output */
 void g2d_bldin_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
-		uint32_t pipe_no)
+		enum g2d_bld_pipe pipe_no, uint32_t x, uint32_t y)
 {
 	uint32_t rect_x, rect_y, rect_w, rect_h;
 	uint32_t reg;
@@ -234,11 +393,8 @@ void g2d_bldin_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
 				BLD_PREMUL_CTL_PIPE1_ALPHA_MODE);
 	}
 
-	/* the horizontal (rect_x) and vertical (rect_y) blend offsets are 
-	 * always set to zero.
-	 */
-	rect_x = 0;
-	rect_y = 0;
+	rect_x = x;
+	rect_y = y;
 	rect_w = frm->sel.r.width;
 	rect_h = frm->sel.r.height;
 
@@ -249,8 +405,13 @@ void g2d_bldin_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
 	reg = (pipe_no) ? BLD_CH_ISIZE1 : BLD_CH_ISIZE0;
 	g2d_write(g2d, reg, tmp);
 
-	tmp = ((rect_y <= 0 ? 0 : rect_y - 1) << 16) 
-		| (rect_x <= 0 ? 0 : rect_x - 1);
+	/*
+	 * The offset is in pixels, as the DE2 mixer blender takes it. The
+	 * vendor code wrote it minus one, which put (0, 0) and (1, 1) at the
+	 * same place.
+	 */
+	tmp = FIELD_PREP(BLD_CH_OFFSET_Y, rect_y);
+	tmp |= FIELD_PREP(BLD_CH_OFFSET_X, rect_x);
 	G2D_INFO_MSG("BLD_CH_ISIZE X:  0x%x\n", rect_x);
 	G2D_INFO_MSG("BLD_CH_ISIZE Y:  0x%x\n", rect_y);
 
@@ -269,20 +430,230 @@ void g2d_bld_cs_set(struct sunxi_g2d *g2d, struct g2d_frame *frm)
 
 	fmt_hw_id = v4l2_fmt_to_hw_id(&frm->v4l2_pix_fmt);
 
-	if (fmt_hw_id <= G2D_FORMAT_BGRA1010102)
-		g2d_clr_bits(g2d, BLD_OUT_COLOR, BLD_OUT_COLOR_ALPHA_MODE);
-	else if (fmt_hw_id <= G2D_FORMAT_YUV411_PLANAR)
+	if (g2d_fmt_is_yuv(fmt_hw_id))
 		g2d_set_bits(g2d, BLD_OUT_COLOR, BLD_OUT_COLOR_ALPHA_MODE);
+	else
+		g2d_clr_bits(g2d, BLD_OUT_COLOR, BLD_OUT_COLOR_ALPHA_MODE);
+}
+
+enum g2d_csc_enc {
+	G2D_CSC_BT601,
+	G2D_CSC_BT709,
+	G2D_CSC_BT2020,
+};
+
+/*
+ * CSC matrices, one row per output channel. Each row holds the 3 input
+ * coefficients followed by a constant. Everything is fixed point with 10
+ * fractional bits, constants being in 8-bit pixel units.
+ * YUV to RGB rows output R, G and B from Y, U and V. RGB to YUV rows
+ * output Y, U and V from R, G and B.
+ */
+static const uint32_t g2d_csc_yuv2rgb[][2][12] = {
+	[G2D_CSC_BT601] = {
+		/* limited range */
+		{
+			0x000004a8, 0x00000000, 0x00000662, 0xfffc8450,
+			0x000004a8, 0xfffffe6f, 0xfffffcc0, 0x00021e4d,
+			0x000004a8, 0x00000812, 0x00000000, 0xfffbaca8,
+		},
+		/* full range */
+		{
+			0x00000400, 0x00000000, 0x0000059c, 0xfffd322d,
+			0x00000400, 0xfffffea0, 0xfffffd25, 0x00021dd6,
+			0x00000400, 0x00000717, 0x00000000, 0xfffc74bc,
+		},
+	},
+	[G2D_CSC_BT709] = {
+		/* limited range */
+		{
+			0x000004a8, 0x00000000, 0x0000072c, 0xfffc1f99,
+			0x000004a8, 0xffffff26, 0xfffffdde, 0x00013383,
+			0x000004a8, 0x00000873, 0x00000000, 0xfffb7bee,
+		},
+		/* full range */
+		{
+			0x00000400, 0x00000000, 0x0000064d, 0xfffcd9b4,
+			0x00000400, 0xffffff40, 0xfffffe21, 0x00014f97,
+			0x00000400, 0x0000076c, 0x00000000, 0xfffc49ef,
+		},
+	},
+	[G2D_CSC_BT2020] = {
+		/* limited range */
+		{
+			0x000004a8, 0x00000000, 0x000006b7, 0xfffc5a00,
+			0x000004a8, 0xffffff40, 0xfffffd66, 0x00016268,
+			0x000004a8, 0x00000891, 0x00000000, 0xfffb6ce4,
+		},
+		/* full range */
+		{
+			0x00000400, 0x00000000, 0x000005e6, 0xfffd0d01,
+			0x00000400, 0xffffff57, 0xfffffdb7, 0x000178c9,
+			0x00000400, 0x00000787, 0x00000000, 0xfffc3cb9,
+		},
+	},
+};
+
+static const uint32_t g2d_csc_rgb2yuv[][2][12] = {
+	[G2D_CSC_BT601] = {
+		/* limited range */
+		{
+			0x00000107, 0x00000204, 0x00000064, 0x00004000,
+			0xffffff68, 0xfffffed6, 0x000001c2, 0x00020000,
+			0x000001c2, 0xfffffe87, 0xffffffb7, 0x00020000,
+		},
+		/* full range */
+		{
+			0x00000132, 0x00000259, 0x00000075, 0x00000000,
+			0xffffff53, 0xfffffead, 0x00000200, 0x00020000,
+			0x00000200, 0xfffffe53, 0xffffffad, 0x00020000,
+		},
+	},
+	[G2D_CSC_BT709] = {
+		/* limited range */
+		{
+			0x000000bb, 0x00000275, 0x0000003f, 0x00004000,
+			0xffffff99, 0xfffffea5, 0x000001c2, 0x00020000,
+			0x000001c2, 0xfffffe67, 0xffffffd7, 0x00020000,
+		},
+		/* full range */
+		{
+			0x000000da, 0x000002dc, 0x0000004a, 0x00000000,
+			0xffffff8b, 0xfffffe75, 0x00000200, 0x00020000,
+			0x00000200, 0xfffffe2f, 0xffffffd1, 0x00020000,
+		},
+	},
+	[G2D_CSC_BT2020] = {
+		/* limited range */
+		{
+			0x000000e7, 0x00000254, 0x00000034, 0x00004000,
+			0xffffff82, 0xfffffebc, 0x000001c2, 0x00020000,
+			0x000001c2, 0xfffffe62, 0xffffffdc, 0x00020000,
+		},
+		/* full range */
+		{
+			0x0000010d, 0x000002b6, 0x0000003d, 0x00000000,
+			0xffffff71, 0xfffffe8f, 0x00000200, 0x00020000,
+			0x00000200, 0xfffffe29, 0xffffffd7, 0x00020000,
+		},
+	},
+};
+
+/*
+ * Pick the matrix of a YUV frame from its negotiated colorimetry, falling
+ * back to the defaults V4L2 derives from the colorspace
+ */
+static void g2d_csc_enc_get(struct g2d_frame *frm, enum g2d_csc_enc *enc,
+		bool *full_range)
+{
+	struct v4l2_pix_format_mplane *pix = &frm->v4l2_pix_fmt;
+	uint32_t ycbcr_enc = pix->ycbcr_enc;
+	uint32_t quantization = pix->quantization;
+
+	if (ycbcr_enc == V4L2_YCBCR_ENC_DEFAULT)
+		ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace);
+
+	if (quantization == V4L2_QUANTIZATION_DEFAULT)
+		quantization = V4L2_MAP_QUANTIZATION_DEFAULT(false,
+					pix->colorspace, ycbcr_enc);
+
+	switch (ycbcr_enc) {
+	case V4L2_YCBCR_ENC_709:
+	case V4L2_YCBCR_ENC_XV709:
+		*enc = G2D_CSC_BT709;
+		break;
+	case V4L2_YCBCR_ENC_BT2020:
+	case V4L2_YCBCR_ENC_BT2020_CONST_LUM:
+		*enc = G2D_CSC_BT2020;
+		break;
+	default:
+		*enc = G2D_CSC_BT601;
+		break;
+	}
+
+	*full_range = (quantization == V4L2_QUANTIZATION_FULL_RANGE);
+}
+
+/*
+ * The blender works in the color space of the output (see g2d_bld_cs_set),
+ * so convert what pipe_no is fed with from frm when the two differ. CSC0
+ * sits on pipe0 and CSC1 on pipe1.
+ */
+void g2d_bld_csc_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
+		enum g2d_bld_pipe pipe_no, struct g2d_frame *out)
+{
+	const uint32_t *matrix;
+	enum g2d_csc_enc enc;
+	bool full_range;
+	bool in_yuv, out_yuv;
+	uint32_t reg;
+	int i;
+
+	in_yuv = g2d_fmt_is_yuv(v4l2_fmt_to_hw_id(&frm->v4l2_pix_fmt));
+	out_yuv = g2d_fmt_is_yuv(v4l2_fmt_to_hw_id(&out->v4l2_pix_fmt));
+
+	if (in_yuv == out_yuv)
+		return;
+
+	if (in_yuv) {
+		g2d_csc_enc_get(frm, &enc, &full_range);
+		matrix = g2d_csc_yuv2rgb[enc][full_range];
+	} else {
+		g2d_csc_enc_get(out, &enc, &full_range);
+		matrix = g2d_csc_rgb2yuv[enc][full_range];
+	}
+
+	G2D_INFO_MSG("CSC%d: enc %d, full range %d\n", pipe_no, enc, full_range);
+
+	reg = (pipe_no) ? BLD_CSC1_COEF00 : BLD_CSC0_COEF00;
+	for (i = 0; i < 12; i++)
+		g2d_write(g2d, reg + (i << 2), matrix[i]);
+
+	g2d_set_bits(g2d, BLD_CSC_CTL, (pipe_no) ? BLD_CSC_CTL_CSC1_EN
+					: BLD_CSC_CTL_CSC0_EN);
+}
+
+/*
+ * The background color is emitted in the blender color space, so an ARGB
+ * color has to be brought to YUV for a YUV output
+ */
+static uint32_t g2d_bk_color(struct g2d_frame *out, uint32_t argb)
+{
+	const uint32_t *matrix;
+	enum g2d_csc_enc enc;
+	bool full_range;
+	int32_t rgb[3], val;
+	uint32_t color;
+	int i;
+
+	if (!g2d_fmt_is_yuv(v4l2_fmt_to_hw_id(&out->v4l2_pix_fmt)))
+		return argb;
+
+	g2d_csc_enc_get(out, &enc, &full_range);
+	matrix = g2d_csc_rgb2yuv[enc][full_range];
+
+	rgb[0] = (argb >> 16) & 0xff;
+	rgb[1] = (argb >> 8) & 0xff;
+	rgb[2] = argb & 0xff;
+
+	color = argb & 0xff000000;
+	for (i = 0; i < 3; i++) {
+		val = (int32_t)matrix[i * 4] * rgb[0]
+			+ (int32_t)matrix[i * 4 + 1] * rgb[1]
+			+ (int32_t)matrix[i * 4 + 2] * rgb[2]
+			+ (int32_t)matrix[i * 4 + 3];
+		color |= clamp(val >> 10, 0, 0xff) << (16 - i * 8);
+	}
+
+	return color;
 }
 
 void g2d_wb_set(struct sunxi_g2d *g2d, struct g2d_frame *frm, 
 		dma_addr_t addr[3])
 {
-	uintptr_t addr0, addr1, addr2;
+	dma_addr_t plane_addr[3];
+	uint32_t pitch[3];
 	uint32_t fmt_hw_id;
-	uint32_t ycnt, ucnt, vcnt;
-	uint32_t pitch0, pitch1, pitch2;
-	uint32_t cw, cy, cx;
 	uint32_t tmp;
 
 	/* write-back pixel format */
@@ -306,75 +677,35 @@ void g2d_wb_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
 	else
 		g2d_clr_bits(g2d, BLD_OUT_COLOR, BLD_OUT_COLOR_PREMUL_EN);
 
-	if ((fmt_hw_id >= G2D_FORMAT_YUV422UVC_V1U1V0U0)
-	      && (fmt_hw_id <= G2D_FORMAT_YUV422_PLANAR)) {
-		cw = frm->v4l2_pix_fmt.width >> 1;
-		cx = frm->sel.r.left >> 1;
-		cy = frm->sel.r.top;
-	}
+	g2d_frame_planes(frm, &frm->sel.r, addr, pitch, plane_addr);
 
-	else if ((fmt_hw_id >= G2D_FORMAT_YUV420UVC_V1U1V0U0)
-		 && (fmt_hw_id <= G2D_FORMAT_YUV420_PLANAR)) {
-		cw = frm->v4l2_pix_fmt.width >> 1;
-		cx = frm->sel.r.left >> 1;
-		cy = frm->sel.r.top >> 1;
-	}
-
-	else if ((fmt_hw_id >= G2D_FORMAT_YUV411UVC_V1U1V0U0)
-		 && (fmt_hw_id <= G2D_FORMAT_YUV411_PLANAR)) {
-		cw = frm->sel.r.left >> 2;
-		cy = frm->sel.r.top;
-	}
-
-	else {
-		cw = 0;
-		cx = 0;
-		cy = 0;
-	}
-
-	fmt2yuvcnt(fmt_hw_id, &ycnt, &ucnt, &vcnt);
-
-	pitch0 = ALIGN(ycnt * frm->v4l2_pix_fmt.width, frm->alignment);
-	g2d_write(g2d, WB_PITCH0, pitch0);
-
-	pitch1 = ALIGN(ucnt * cw, frm->alignment);
-	g2d_write(g2d, WB_PITCH1, pitch1);
-	
-	pitch2 = ALIGN(vcnt * cw, frm->alignment);
-	g2d_write(g2d, WB_PITCH2, pitch2);
-
-	G2D_INFO_MSG("OutputPitch: %d, %d, %d\n", pitch0, pitch1, pitch2);
-
-	addr0 =
-		addr[0] + pitch0 * frm->sel.r.top + ycnt * frm->sel.r.left;
-	g2d_write(g2d, WB_LADD0, addr0 & GENMASK(31, 0));
-#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
-	g2d_write(g2d, WB_HADD0, addr0 >> 32);
-#endif
+	g2d_write(g2d, WB_PITCH0, pitch[0]);
+	g2d_write(g2d, WB_PITCH1, pitch[1]);
+	g2d_write(g2d, WB_PITCH2, pitch[2]);
 
-	addr1 = addr[1] + pitch1 * cy + ucnt * cx;
-	g2d_write(g2d, WB_LADD1, addr1 & GENMASK(31, 0));
-#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
-	g2d_write(g2d, WB_HADD1, addr1 >> 32);
-#endif
+	G2D_INFO_MSG("OutputPitch: %d, %d, %d\n", pitch[0], pitch[1], pitch[2]);
 
-	addr2 = addr[2] + pitch2 * cy + vcnt * cx;
-	g2d_write(g2d, WB_LADD2, addr2 & GENMASK(31, 0));
+	g2d_write(g2d, WB_LADD0, lower_32_bits(plane_addr[0]));
+	g2d_write(g2d, WB_LADD1, lower_32_bits(plane_addr[1]));
+	g2d_write(g2d, WB_LADD2, lower_32_bits(plane_addr[2]));
 #ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
-	g2d_write(g2d, WB_HADD2, addr2 >> 32);
+	if (g2d->variant->addr_40bit) {
+		g2d_write(g2d, WB_HADD0, upper_32_bits(plane_addr[0]));
+		g2d_write(g2d, WB_HADD1, upper_32_bits(plane_addr[1]));
+		g2d_write(g2d, WB_HADD2, upper_32_bits(plane_addr[2]));
+	}
 #endif
 
-	G2D_INFO_MSG("WbAddr: 0x%lx, 0x%lx, 0x%lx\n", addr0, addr1, addr2);
+	G2D_INFO_MSG("WbAddr: %pad, %pad, %pad\n",
+			&plane_addr[0], &plane_addr[1], &plane_addr[2]);
 }
 
 void g2d_vlayer_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
 		dma_addr_t addr[3], uint32_t layer_alpha)
 {
-	uintptr_t addr0, addr1, addr2;
+	dma_addr_t plane_addr[3];
+	uint32_t pitch[3];
 	uint32_t fmt_hw_id;
-	uint32_t ycnt, ucnt, vcnt;
-	uint32_t pitch0, pitch1, pitch2;
-	uint32_t cw, cy, cx;
 	uint32_t tmp;
 
 	tmp = FIELD_PREP(V0_ATTCTL_GLBALPHA, layer_alpha);
@@ -398,98 +729,1279 @@ void g2d_vlayer_set(struct sunxi_g2d *g2d, struct g2d_frame *frm,
 	g2d_write(g2d, V0_SIZE, tmp);
 	g2d_write(g2d, V0_COOR, 0);
 
-	if ((fmt_hw_id >= G2D_FORMAT_YUV422UVC_V1U1V0U0)
-	      && (fmt_hw_id <= G2D_FORMAT_YUV422_PLANAR)) {
-		cw = frm->sel.r.width >> 1;
-		cx = frm->sel.r.left >> 1;
-		cy = frm->sel.r.top;
-	}
+	g2d_frame_planes(frm, &frm->sel.r, addr, pitch, plane_addr);
 
-	else if ((fmt_hw_id >= G2D_FORMAT_YUV420UVC_V1U1V0U0)
-		 && (fmt_hw_id <= G2D_FORMAT_YUV420_PLANAR)) {
-		cw = frm->sel.r.width >> 1;
-		cx = frm->sel.r.left >> 1;
-		cy = frm->sel.r.top >> 1;
+	g2d_write(g2d, V0_PITCH0, pitch[0]);
+	g2d_write(g2d, V0_PITCH1, pitch[1]);
+	g2d_write(g2d, V0_PITCH2, pitch[2]);
+
+	G2D_INFO_MSG("VInPITCH: %d, %d, %d\n",
+				pitch[0], pitch[1], pitch[2]);
+
+	/* address of the rectangle */
+	g2d_write(g2d, V0_LADDR0, lower_32_bits(plane_addr[0]));
+	g2d_write(g2d, V0_LADDR1, lower_32_bits(plane_addr[1]));
+	g2d_write(g2d, V0_LADDR2, lower_32_bits(plane_addr[2]));
+
+	/* Some G2Ds support 40-bit bus addresses. Only fill V0_HADDR if we're
+	 * dealing with 64-bit DMA addresses on one of them
+	 */
+#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
+	if (g2d->variant->addr_40bit) {
+		tmp = FIELD_PREP(V0_HADDR0, upper_32_bits(plane_addr[0]));
+		tmp |= FIELD_PREP(V0_HADDR1, upper_32_bits(plane_addr[1]));
+		tmp |= FIELD_PREP(V0_HADDR2, upper_32_bits(plane_addr[2]));
+		g2d_write(g2d, V0_HADDR, tmp);
 	}
+#endif
+
+	G2D_INFO_MSG("VInAddrA: %pad, %pad, %pad\n",
+			&plane_addr[0], &plane_addr[1], &plane_addr[2]);
+}
+
+/* set the same source and destination factors for both color and alpha */
+static void g2d_bld_ctl_set(struct sunxi_g2d *g2d, uint32_t src_factor,
+		uint32_t dst_factor)
+{
+	uint32_t tmp;
+
+	tmp = FIELD_PREP(BLD_CTL_PIXEL_SRC_FACTOR, src_factor);
+	tmp |= FIELD_PREP(BLD_CTL_PIXEL_DST_FACTOR, dst_factor);
+	tmp |= FIELD_PREP(BLD_CTL_ALPHA_SRC_FACTOR, src_factor);
+	tmp |= FIELD_PREP(BLD_CTL_ALPHA_DST_FACTOR, dst_factor);
+	g2d_write(g2d, BLD_CTL, tmp);
+}
+
+/* ROP sel ch0 pass */
+static void g2d_rop_bypass_set(struct sunxi_g2d *g2d)
+{
+	g2d_write(g2d, ROP_CTL, ROP_CTL_BLUE_BYPASS_EN 
+				| ROP_CTL_GREEN_BYPASS_EN
+				| ROP_CTL_RED_BYPASS_EN 
+				| ROP_CTL_ALPHA_BYPASS_EN);
+}
+
+static void g2d_mixer_start(struct sunxi_g2d *g2d)
+{
+	G2D_INFO_MSG("Starting the module");
+	g2d_mixer_irq_enable(g2d);
+	g2d_set_bits(g2d, G2D_MIXER_CTL, G2D_MIXER_CTL_START);
+}
+
+/*
+ * VSU polyphase filters. Each word packs the 4 signed taps of one of the 32
+ * phases, the tap left of the sampling position being in the low byte, and
+ * the taps of every phase add up to 64.
+ *
+ * Horizontal filters are lanczos2 windows whose cutoff follows the downscale
+ * ratio, one bank per ratio range. Vertical filtering is linear.
+ */
+static const uint32_t g2d_vsu_hcoef[] = {
+	/* up to 1x */
+	0x00004000, 0x000140ff, 0x00033ffe, 0x00053efd,
+	0x00063efc, 0x00083cfc, 0xff0a3cfb, 0xff0d39fb,
+	0xff0f37fb, 0xff1135fb, 0xfe1433fb, 0xfe1631fb,
+	0xfe192efb, 0xfd1c2cfb, 0xfd1f29fb, 0xfc2127fc,
+	0xfc2424fc, 0xfc2721fc, 0xfb291ffd, 0xfb2c1cfd,
+	0xfb2e19fe, 0xfb3116fe, 0xfb3314fe, 0xfb3511ff,
+	0xfb370fff, 0xfb390dff, 0xfb3c0aff, 0xfc3c0800,
+	0xfc3e0600, 0xfd3e0500, 0xfe3f0300, 0xff400100,
+	/* up to 1.5x */
+	0xfd0e270e, 0xfd0f270d, 0xfd10270c, 0xfd11280a,
+	0xfd122809, 0xfd142708, 0xfd152608, 0xfd162607,
+	0xfd172606, 0xfd182605, 0xfe192504, 0xfe1b2403,
+	0xfe1c2303, 0xff1d2202, 0xff1e2201, 0xff1f2101,
+	0x00202000, 0x01211fff, 0x01221eff, 0x02221dff,
+	0x03231cfe, 0x03241bfe, 0x042519fe, 0x052618fd,
+	0x062617fd, 0x072616fd, 0x082615fd, 0x082714fd,
+	0x092812fd, 0x0a2811fd, 0x0c2710fd, 0x0d270ffd,
+	/* up to 2x */
+	0x00111e11, 0x00121e10, 0x01121d10, 0x01131d0f,
+	0x01131e0e, 0x02141c0e, 0x02141d0d, 0x02151d0c,
+	0x03151c0c, 0x03161c0b, 0x04161c0a, 0x04171b0a,
+	0x05171b09, 0x05181b08, 0x06181a08, 0x06191a07,
+	0x07191907, 0x071a1906, 0x081a1806, 0x081b1805,
+	0x091b1705, 0x0a1b1704, 0x0a1c1604, 0x0b1c1603,
+	0x0c1c1503, 0x0c1d1502, 0x0d1d1402, 0x0e1c1402,
+	0x0e1e1301, 0x0f1d1301, 0x101d1201, 0x101e1200,
+	/* up to 3x */
+	0x07111711, 0x08111611, 0x08121511, 0x08121610,
+	0x09121510, 0x09121510, 0x0912160f, 0x0913150f,
+	0x0a13140f, 0x0a13150e, 0x0a13150e, 0x0b13140e,
+	0x0b13150d, 0x0b13150d, 0x0b14140d, 0x0c14140c,
+	0x0c14140c, 0x0c14140c, 0x0d14140b, 0x0d15130b,
+	0x0d15130b, 0x0e14130b, 0x0e15130a, 0x0e15130a,
+	0x0f14130a, 0x0f151309, 0x0f161209, 0x10151209,
+	0x10151209, 0x10161208, 0x11151208, 0x11161108,
+	/* above 3x */
+	0x0b111311, 0x0b111311, 0x0b111410, 0x0c111310,
+	0x0c111310, 0x0c111310, 0x0c111310, 0x0c111310,
+	0x0c12130f, 0x0d12120f, 0x0d12120f, 0x0d12120f,
+	0x0d12120f, 0x0d12130e, 0x0d12130e, 0x0e12120e,
+	0x0e12120e, 0x0e12120e, 0x0e13120d, 0x0e13120d,
+	0x0f12120d, 0x0f12120d, 0x0f12120d, 0x0f12120d,
+	0x0f13120c, 0x1013110c, 0x1013110c, 0x1013110c,
+	0x1013110c, 0x1013110c, 0x1014110b, 0x1113110b,
+};
+
+static const uint32_t g2d_vsu_vcoef[] = {
+	0x00004000, 0x00023e00, 0x00043c00, 0x00063a00,
+	0x00083800, 0x000a3600, 0x000c3400, 0x000e3200,
+	0x00103000, 0x00122e00, 0x00142c00, 0x00162a00,
+	0x00182800, 0x001a2600, 0x001c2400, 0x001e2200,
+	0x00202000, 0x00221e00, 0x00241c00, 0x00261a00,
+	0x00281800, 0x002a1600, 0x002c1400, 0x002e1200,
+	0x00301000, 0x00320e00, 0x00340c00, 0x00360a00,
+	0x00380800, 0x003a0600, 0x003c0400, 0x003e0200,
+};
+
+/* input pixels walked per output pixel */
+static uint32_t g2d_vsu_step(uint32_t in, uint32_t out)
+{
+	return div_u64((u64)in << VS_STEP_FRAC_BITS, max(out, 1U));
+}
+
+/* Pick the coefficient bank matching a downscaling step */
+static unsigned int g2d_scaler_bank(uint32_t step)
+{
+	const uint32_t one = 1 << VS_STEP_FRAC_BITS;
+
+	if (step <= one)
+		return 0;
+	else if (step <= one + one / 2)
+		return 1;
+	else if (step <= 2 * one)
+		return 2;
+	else if (step <= 3 * one)
+		return 3;
+
+	return 4;
+}
+
+static const uint32_t *g2d_vsu_hcoef_bank(uint32_t step)
+{
+	return &g2d_vsu_hcoef[g2d_scaler_bank(step) * VS_PHASE_NUM];
+}
+
+/* Steps and first phases of a scale, fixed point with 20 fractional bits */
+struct g2d_scale_pos {
+	uint32_t hstep;
+	uint32_t vstep;
+	uint32_t hphase;
+	uint32_t vphase;
+};
+
+/*
+ * Scale the video layer from in_w x in_h to out_w x out_h, with the steps
+ * and phases of pos, in luma pixels. Luma and chroma are scaled separately,
+ * the chroma planes of subsampled YUV formats being smaller than the luma
+ * one.
+ */
+static void g2d_vsu_set(struct sunxi_g2d *g2d, uint32_t fmt_hw_id,
+		uint32_t in_w, uint32_t in_h, uint32_t out_w, uint32_t out_h,
+		const struct g2d_scale_pos *pos, uint32_t layer_alpha)
+{
+	const uint32_t *y_hcoef, *c_hcoef;
+	uint32_t hsub, vsub;
+	uint32_t hstep = pos->hstep;
+	uint32_t vstep = pos->vstep;
+	uint32_t tmp;
+	int i;
+
+	fmt2subsampling(fmt_hw_id, &hsub, &vsub);
+
+	tmp = FIELD_PREP(VS_SIZE_WIDTH, out_w - 1);
+	tmp |= FIELD_PREP(VS_SIZE_HEIGHT, out_h - 1);
+	g2d_write(g2d, VS_OUT_SIZE, tmp);
+
+	g2d_write(g2d, VS_GLB_ALPHA, layer_alpha & 0xff);
+
+	tmp = FIELD_PREP(VS_SIZE_WIDTH, in_w - 1);
+	tmp |= FIELD_PREP(VS_SIZE_HEIGHT, in_h - 1);
+	g2d_write(g2d, VS_Y_SIZE, tmp);
+
+	tmp = FIELD_PREP(VS_SIZE_WIDTH, DIV_ROUND_UP(in_w, hsub) - 1);
+	tmp |= FIELD_PREP(VS_SIZE_HEIGHT, DIV_ROUND_UP(in_h, vsub) - 1);
+	g2d_write(g2d, VS_C_SIZE, tmp);
+
+	G2D_INFO_MSG("VSU step: 0x%x, 0x%x, phase: 0x%x, 0x%x\n",
+			hstep, vstep, pos->hphase, pos->vphase);
+
+	g2d_write(g2d, VS_Y_HSTEP, FIELD_PREP(VS_STEP_VAL, hstep));
+	g2d_write(g2d, VS_Y_VSTEP, FIELD_PREP(VS_STEP_VAL, vstep));
+	g2d_write(g2d, VS_C_HSTEP, FIELD_PREP(VS_STEP_VAL, hstep / hsub));
+	g2d_write(g2d, VS_C_VSTEP, FIELD_PREP(VS_STEP_VAL, vstep / vsub));
+
+	g2d_write(g2d, VS_Y_HPHASE, FIELD_PREP(VS_PHASE_VAL, pos->hphase));
+	g2d_write(g2d, VS_Y_VPHASE0, FIELD_PREP(VS_PHASE_VAL, pos->vphase));
+	g2d_write(g2d, VS_C_HPHASE,
+			FIELD_PREP(VS_PHASE_VAL, pos->hphase / hsub));
+	g2d_write(g2d, VS_C_VPHASE0,
+			FIELD_PREP(VS_PHASE_VAL, pos->vphase / vsub));
+
+	y_hcoef = g2d_vsu_hcoef_bank(hstep);
+	c_hcoef = g2d_vsu_hcoef_bank(hstep / hsub);
 
-	else if ((fmt_hw_id >= G2D_FORMAT_YUV411UVC_V1U1V0U0)
-		 && (fmt_hw_id <= G2D_FORMAT_YUV411_PLANAR)) {
-		cx = frm->sel.r.left >> 2;
-		cy = frm->sel.r.top;
+	for (i = 0; i < VS_PHASE_NUM; i++) {
+		g2d_write(g2d, VS_Y_HCOEF0 + (i << 2), y_hcoef[i]);
+		g2d_write(g2d, VS_Y_VCOEF0 + (i << 2), g2d_vsu_vcoef[i]);
+		g2d_write(g2d, VS_C_HCOEF0 + (i << 2), c_hcoef[i]);
 	}
 
-	else {
-		cw = 0;
-		cx = 0;
-		cy = 0;
+	/* latch the new coefficients */
+	g2d_write(g2d, VS_CTRL, VS_CTRL_EN | VS_CTRL_COEF_SWITCH);
+}
+
+/*
+ * 4-tap polyphase filters of the GSU, 16 phases per bank, in the same
+ * bank order as the VSU ones.
+ */
+static const uint32_t g2d_gsu_hcoef[] = {
+	/* up to 1x */
+	0x00004000, 0x00033ffe, 0x00063efc, 0xff0a3cfb,
+	0xff0f37fb, 0xfe1433fb, 0xfe192efb, 0xfd1f29fb,
+	0xfc2424fc, 0xfb291ffd, 0xfb2e19fe, 0xfb3314fe,
+	0xfb370fff, 0xfb3c0aff, 0xfc3e0600, 0xfe3f0300,
+	/* up to 1.5x */
+	0xfd0e270e, 0xfd10270c, 0xfd122809, 0xfd152608,
+	0xfd172606, 0xfe192504, 0xfe1c2303, 0xff1e2201,
+	0x00202000, 0x01221eff, 0x03231cfe, 0x042519fe,
+	0x062617fd, 0x082615fd, 0x092812fd, 0x0c2710fd,
+	/* up to 2x */
+	0x00111e11, 0x01121d10, 0x01131e0e, 0x02141d0d,
+	0x03151c0c, 0x04161c0a, 0x05171b09, 0x06181a08,
+	0x07191907, 0x081a1806, 0x091b1705, 0x0a1c1604,
+	0x0c1c1503, 0x0d1d1402, 0x0e1e1301, 0x101d1201,
+	/* up to 3x */
+	0x07111711, 0x08121511, 0x09121510, 0x0912160f,
+	0x0a13140f, 0x0a13150e, 0x0b13150d, 0x0b14140d,
+	0x0c14140c, 0x0d14140b, 0x0d15130b, 0x0e15130a,
+	0x0f14130a, 0x0f161209, 0x10151209, 0x11151208,
+	/* above 3x */
+	0x0b111311, 0x0b111410, 0x0c111310, 0x0c111310,
+	0x0c12130f, 0x0d12120f, 0x0d12120f, 0x0d12130e,
+	0x0e12120e, 0x0e13120d, 0x0f12120d, 0x0f12120d,
+	0x0f13120c, 0x1013110c, 0x1013110c, 0x1014110b,
+};
+
+/*
+ * Work out the span [*first, *last) of the n source pixels the filter taps
+ * reach for the len output pixels starting at off, and the phase of the
+ * first of them relative to *first. The span starts on a multiple of sub so
+ * that the chroma planes stay aligned with the luma one.
+ */
+static void g2d_scale_span(uint32_t off, uint32_t len, uint32_t step,
+		uint32_t n, uint32_t sub, uint32_t *first, uint32_t *last,
+		uint32_t *phase)
+{
+	u64 start = (u64)off * step;
+	u64 end = (u64)(off + len - 1) * step;
+	uint32_t s = start >> VS_STEP_FRAC_BITS;
+	uint32_t e = end >> VS_STEP_FRAC_BITS;
+
+	s = rounddown(s > VS_TAPS_LEFT ? s - VS_TAPS_LEFT : 0, sub);
+
+	*first = s;
+	*last = min(e + VS_TAPS_RIGHT + 1, n);
+	*phase = start - ((u64)s << VS_STEP_FRAC_BITS);
+}
+
+/*
+ * Map the output pixels [a, b) of a line scaled from in to out pixels onto
+ * the span of source pixels feeding them. Unscaled lines map exactly.
+ */
+static void g2d_scale_axis(uint32_t a, uint32_t b, uint32_t in, uint32_t out,
+		uint32_t *first, uint32_t *last, uint32_t *step,
+		uint32_t *phase)
+{
+	if (in == out) {
+		*first = a;
+		*last = b;
+		*step = 1 << VS_STEP_FRAC_BITS;
+		*phase = 0;
+		return;
 	}
 
+	*step = g2d_vsu_step(in, out);
+	g2d_scale_span(a, b - a, *step, in, 1, first, last, phase);
+}
+
+/*
+ * Scale the UI layer feeding pipe1 from in_w x in_h to out_w x out_h, with
+ * the steps and phases of pos
+ */
+static void g2d_gsu_set(struct sunxi_g2d *g2d, uint32_t in_w, uint32_t in_h,
+		uint32_t out_w, uint32_t out_h, const struct g2d_scale_pos *pos)
+{
+	const uint32_t *hcoef;
+	uint32_t tmp;
+	int i;
+
+	tmp = FIELD_PREP(VS_SIZE_WIDTH, out_w - 1);
+	tmp |= FIELD_PREP(VS_SIZE_HEIGHT, out_h - 1);
+	g2d_write(g2d, GS_OUT_SIZE, tmp);
+
+	tmp = FIELD_PREP(VS_SIZE_WIDTH, in_w - 1);
+	tmp |= FIELD_PREP(VS_SIZE_HEIGHT, in_h - 1);
+	g2d_write(g2d, GS_IN_SIZE, tmp);
+
+	G2D_INFO_MSG("GSU step: 0x%x, 0x%x, phase: 0x%x, 0x%x\n",
+			pos->hstep, pos->vstep, pos->hphase, pos->vphase);
+
+	g2d_write(g2d, GS_HSTEP, FIELD_PREP(VS_STEP_VAL, pos->hstep));
+	g2d_write(g2d, GS_VSTEP, FIELD_PREP(VS_STEP_VAL, pos->vstep));
+	g2d_write(g2d, GS_HPHASE, FIELD_PREP(VS_PHASE_VAL, pos->hphase));
+	g2d_write(g2d, GS_VPHASE, FIELD_PREP(VS_PHASE_VAL, pos->vphase));
+
+	hcoef = &g2d_gsu_hcoef[g2d_scaler_bank(pos->hstep) * GS_PHASE_NUM];
+	for (i = 0; i < GS_PHASE_NUM; i++)
+		g2d_write(g2d, GS_HCOEF0 + (i << 2), hcoef[i]);
+
+	/* latch the new coefficients */
+	g2d_write(g2d, GS_CTRL, GS_CTRL_EN | GS_CTRL_COEF_SWITCH);
+}
+
+/*
+ * UI layers only take RGB formats, so a single plane is fetched.
+ * layer_no must be one of the UI layers.
+ */
+void g2d_uilayer_set(struct sunxi_g2d *g2d, enum g2d_layer layer_no,
+		struct g2d_frame *frm, dma_addr_t addr[3], uint32_t layer_alpha)
+{
+	uint32_t n = layer_no - G2D_LAYER_UI0;
+	dma_addr_t addr0;
+	uint32_t fmt_hw_id;
+	uint32_t ycnt, ucnt, vcnt;
+	uint32_t pitch0;
+	uint32_t tmp;
+
+	tmp = FIELD_PREP(UI_ATTR_GLBALPHA, layer_alpha);
+
+	if (frm->premult_alpha)
+		tmp |= FIELD_PREP(UI_ATTR_PREMUL_CTL, 0x2);
+
+	fmt_hw_id = v4l2_fmt_to_hw_id(&frm->v4l2_pix_fmt);
+	tmp |= FIELD_PREP(UI_ATTR_FBFMT, fmt_hw_id);
+	tmp |= FIELD_PREP(UI_ATTR_ALPHA_MODE, frm->alpha_bld_mode);
+	tmp |= FIELD_PREP(UI_ATTR_EN, 1);
+	g2d_write(g2d, UI_ATTR(n), tmp);
+
+	tmp = FIELD_PREP(UI_MBSIZE_WIDTH, (frm->sel.r.width == 0 ?
+				0 : frm->sel.r.width - 1));
+	tmp |= FIELD_PREP(UI_MBSIZE_HEIGHT, (frm->sel.r.height == 0 ? 
+				0 : frm->sel.r.height - 1));
+	g2d_write(g2d, UI_MBSIZE(n), tmp);
+
+	/* offset is set to 0, overlay size is set to layer size */
+	g2d_write(g2d, UI_SIZE(n), tmp);
+	g2d_write(g2d, UI_COOR(n), 0);
+
 	fmt2yuvcnt(fmt_hw_id, &ycnt, &ucnt, &vcnt);
 
 	pitch0 = ALIGN(ycnt * frm->v4l2_pix_fmt.width, frm->alignment);
-	g2d_write(g2d, V0_PITCH0, pitch0);
-	
-	pitch1 = ALIGN(ucnt * cw, frm->alignment);
-	g2d_write(g2d, V0_PITCH1, pitch1);
-
-	pitch2 = ALIGN(vcnt * cw, frm->alignment);
-	g2d_write(g2d, V0_PITCH2, pitch2);
-	
-	G2D_INFO_MSG("VInPITCH: %d, %d, %d\n",
-				pitch0, pitch1, pitch2);
-	G2D_INFO_MSG("VInAddrB: 0x%x, 0x%x, 0x%x\n",
-			addr[0], addr[1], addr[2]);
+	g2d_write(g2d, UI_PITCH(n), pitch0);
 
-	/* address of the rectangle */
 	addr0 =
 		addr[0] + pitch0 * frm->sel.r.top + ycnt * frm->sel.r.left;
-	g2d_write(g2d, V0_LADDR0, addr0 & GENMASK(31, 0));
+	g2d_write(g2d, UI_LADD(n), lower_32_bits(addr0));
+#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
+	if (g2d->variant->addr_40bit)
+		g2d_write(g2d, UI_HADD(n), upper_32_bits(addr0));
+#endif
 
-	addr1 = addr[1] + pitch1 * cy + ucnt * cx;
-	g2d_write(g2d, V0_LADDR1, addr1 & GENMASK(31, 0));
+	G2D_INFO_MSG("UI%d InAddr: %pad, pitch %d\n", n, &addr0, pitch0);
+}
 
-	addr2 = addr[2] + pitch2 * cy + vcnt * cx;
-	g2d_write(g2d, V0_LADDR2, addr2 & GENMASK(31, 0));
+/* min and max are inclusive RGB888 bounds */
+void g2d_ck_set(struct sunxi_g2d *g2d, enum g2d_ckey_mode mode,
+		uint32_t min, uint32_t max)
+{
+	if (mode == G2D_CKEY_NONE)
+		return;
 
-	/* The G2D can support 40-bit bus addresses. Only fill V0_HADDR if we're dealing
-	 * with 64-bit DMA addresses
-	 */
-#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
-	tmp = FIELD_PREP(V0_HADDR0, addr[0]);
-	tmp |= FIELD_PREP(V0_HADDR1, addr[1]);
-	tmp |= FIELD_PREP(V0_HADDR2, addr[2]);
-	g2d_write(g2d, V0_HADDR, tmp);`
-#endif
+	G2D_INFO_MSG("COLORKEY: mode: %d, [0x%x, 0x%x]\n", mode, min, max);
 
-	G2D_INFO_MSG("VInAddrA: 0x%lx, 0x%lx, 0x%lx\n",
-							addr0, addr1, addr2);
+	/* match the pixels within [min, max] on every channel */
+	g2d_write(g2d, BLD_KEY_CON, 0);
+	g2d_write(g2d, BLD_KEY_MAX, FIELD_PREP(BLD_KEY_COLOR, max));
+	g2d_write(g2d, BLD_KEY_MIN, FIELD_PREP(BLD_KEY_COLOR, min));
+
+	/* the source is on pipe1 */
+	g2d_write(g2d, BLD_KEY_CTL, BLD_KEY_CTL_EN
+			| (mode == G2D_CKEY_SRC ? BLD_KEY_CTL_SRC : 0));
 }
 
-void g2d_rectfill(struct sunxi_g2d_ctx *ctx, dma_addr_t addr[3])
+/* BLD_CTL source and destination factors of each porter-duff rule */
+static const uint8_t g2d_porter_duff_factors[][2] = {
+	[G2D_BLD_CLEAR]		= { BLD_FACTOR_ZERO, BLD_FACTOR_ZERO },
+	[G2D_BLD_SRC]		= { BLD_FACTOR_ONE, BLD_FACTOR_ZERO },
+	[G2D_BLD_DST]		= { BLD_FACTOR_ZERO, BLD_FACTOR_ONE },
+	[G2D_BLD_SRC_OVER]	= { BLD_FACTOR_ONE, BLD_FACTOR_INV_ALPHA },
+	[G2D_BLD_DST_OVER]	= { BLD_FACTOR_INV_ALPHA, BLD_FACTOR_ONE },
+	[G2D_BLD_SRC_IN]	= { BLD_FACTOR_ALPHA, BLD_FACTOR_ZERO },
+	[G2D_BLD_DST_IN]	= { BLD_FACTOR_ZERO, BLD_FACTOR_ALPHA },
+	[G2D_BLD_SRC_OUT]	= { BLD_FACTOR_INV_ALPHA, BLD_FACTOR_ZERO },
+	[G2D_BLD_DST_OUT]	= { BLD_FACTOR_ZERO, BLD_FACTOR_INV_ALPHA },
+	[G2D_BLD_SRC_ATOP]	= { BLD_FACTOR_ALPHA, BLD_FACTOR_INV_ALPHA },
+	[G2D_BLD_DST_ATOP]	= { BLD_FACTOR_INV_ALPHA, BLD_FACTOR_ALPHA },
+	[G2D_BLD_XOR]		= { BLD_FACTOR_INV_ALPHA, BLD_FACTOR_INV_ALPHA },
+};
+
+void g2d_rectfill(struct g2d_job *job, dma_addr_t addr[3])
 {
+	struct g2d_frame dst = job->dst;
+
+	g2d_tile_clip(job, &dst.sel.r, NULL);
+
 	/* Maybe only reset the mixer ?? */
-	// g2d_mixer_reset(ctx->g2d);
-	g2d_hw_reset(ctx->g2d); 
+	// g2d_mixer_reset(job->g2d);
+	g2d_hw_reset(job->g2d); 
 
 	/* prepare the mixer video layer */
-	g2d_vlayer_set(ctx->g2d, &ctx->dst, addr, ctx->rectfill_color_alpha);
+	g2d_vlayer_set(job->g2d, &dst, addr, job->rectfill_color_alpha);
 
 	/* set the fill color */
-	g2d_fc_set(ctx->g2d, 0, ctx->rectfill_color);
+	g2d_fc_set(job->g2d, G2D_LAYER_V0, job->rectfill_color);
 
-	g2d_bldin_set(ctx->g2d, &ctx->dst, 0);
-	g2d_bld_cs_set(ctx->g2d, &ctx->dst);
+	g2d_bldin_set(job->g2d, &dst, G2D_BLD_PIPE0, 0, 0);
+	g2d_bld_cs_set(job->g2d, &dst);
 
-	/* ROP sel ch0 pass */
-	g2d_write(ctx->g2d, ROP_CTL, ROP_CTL_BLUE_BYPASS_EN 
-				| ROP_CTL_GREEN_BYPASS_EN
-				| ROP_CTL_RED_BYPASS_EN 
-				| ROP_CTL_ALPHA_BYPASS_EN);
+	g2d_rop_bypass_set(job->g2d);
 	
-	g2d_wb_set(ctx->g2d, &ctx->dst, addr);
+	g2d_wb_set(job->g2d, &dst, addr);
 
 	/* start the module */
-	G2D_INFO_MSG("Starting the module");
-	g2d_mixer_irq_enable(ctx->g2d);
-	g2d_set_bits(ctx->g2d, G2D_MIXER_CTL, G2D_MIXER_CTL_START);
-}
\ No newline at end of file
+	g2d_mixer_start(job->g2d);
+}
+
+static bool g2d_rect_overlap(struct v4l2_rect *a, struct v4l2_rect *b)
+{
+	return a->left < b->left + (int32_t)b->width &&
+		b->left < a->left + (int32_t)a->width &&
+		a->top < b->top + (int32_t)b->height &&
+		b->top < a->top + (int32_t)a->height;
+}
+
+static void g2d_rect_bbox(struct g2d_fill_rect *rects, unsigned int count,
+		struct v4l2_rect *bbox)
+{
+	int32_t right, bottom;
+	unsigned int i;
+
+	*bbox = rects[0].r;
+	right = bbox->left + bbox->width;
+	bottom = bbox->top + bbox->height;
+
+	for (i = 1; i < count; i++) {
+		bbox->left = min(bbox->left, rects[i].r.left);
+		bbox->top = min(bbox->top, rects[i].r.top);
+		right = max(right, rects[i].r.left + (int32_t)rects[i].r.width);
+		bottom = max(bottom, rects[i].r.top + (int32_t)rects[i].r.height);
+	}
+
+	bbox->width = right - bbox->left;
+	bbox->height = bottom - bbox->top;
+}
+
+/*
+ * Number of leading rectangles, up to one per layer of the mixer, that can
+ * be filled in a single pass. That is the case when they don't overlap and
+ * exactly cover their bounding box, as anything else inside it would be
+ * overwritten, and the bounding box is no larger than a pass.
+ */
+unsigned int g2d_rectfill_pack(const struct g2d_variant *variant,
+		struct g2d_fill_rect *rects, unsigned int count)
+{
+	struct v4l2_rect bbox;
+	uint64_t area;
+	unsigned int n, i, j;
+
+	for (n = min(count, 4U); n > 1; n--) {
+		area = 0;
+		for (i = 0; i < n; i++) {
+			area += (uint64_t)rects[i].r.width * rects[i].r.height;
+			for (j = i + 1; j < n; j++)
+				if (g2d_rect_overlap(&rects[i].r, &rects[j].r))
+					goto next;
+		}
+
+		g2d_rect_bbox(rects, n, &bbox);
+		if (area == (uint64_t)bbox.width * bbox.height &&
+			bbox.width <= variant->pass_width &&
+			bbox.height <= variant->pass_height)
+			return n;
+next:
+		;
+	}
+
+	return 1;
+}
+
+/*
+ * Clear the compose rectangle to the rectfill color. No layer is enabled,
+ * the blender just emits its background color into write-back, so there
+ * is nothing to fetch and little to program.
+ */
+void g2d_clear(struct g2d_job *job, dma_addr_t addr[3])
+{
+	struct g2d_frame dst = job->dst;
+
+	g2d_tile_clip(job, &dst.sel.r, NULL);
+
+	g2d_hw_reset(job->g2d);
+
+	g2d_write(job->g2d, BLD_BK_COLOR,
+			g2d_bk_color(&dst, job->rectfill_color));
+	g2d_bld_cs_set(job->g2d, &dst);
+
+	g2d_wb_set(job->g2d, &dst, addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/* Make layer_no fill r, bbox being the whole area covered by the pass */
+static void g2d_fill_layer_set(struct g2d_job *job,
+		enum g2d_layer layer_no, dma_addr_t addr[3],
+		struct g2d_fill_rect *rect, struct v4l2_rect *bbox)
+{
+	struct g2d_frame frm = job->dst;
+	uint32_t size, coor;
+
+	frm.sel.r = rect->r;
+
+	size = FIELD_PREP(V0_MBSIZE_WIDTH, bbox->width - 1);
+	size |= FIELD_PREP(V0_MBSIZE_HEIGHT, bbox->height - 1);
+	coor = FIELD_PREP(LAY_COOR_X, rect->r.left - bbox->left);
+	coor |= FIELD_PREP(LAY_COOR_Y, rect->r.top - bbox->top);
+
+	if (layer_no == G2D_LAYER_V0) {
+		g2d_vlayer_set(job->g2d, &frm, addr,
+				job->rectfill_color_alpha);
+		g2d_write(job->g2d, V0_SIZE, size);
+		g2d_write(job->g2d, V0_COOR, coor);
+	} else {
+		g2d_uilayer_set(job->g2d, layer_no, &frm, addr,
+				job->rectfill_color_alpha);
+		g2d_write(job->g2d, UI_SIZE(layer_no - G2D_LAYER_UI0), size);
+		g2d_write(job->g2d, UI_COOR(layer_no - G2D_LAYER_UI0), coor);
+	}
+
+	g2d_fc_set(job->g2d, layer_no, rect->color);
+}
+
+/*
+ * Fill count (1 to 4) rectangles packed by g2d_rectfill_pack in one pass.
+ * V0, UI0 and UI1 each fill one and, every channel being transparent black
+ * outside of its layer, are OR'ed together by the ROP unit. UI2 fills the
+ * fourth one on pipe1, which is only blended in over its own rectangle.
+ */
+void g2d_rectfill_multi(struct g2d_job *job, dma_addr_t addr[3],
+		struct g2d_fill_rect *rects, unsigned int count)
+{
+	struct g2d_frame dst = job->dst;
+	struct g2d_frame ui2 = job->dst;
+	struct v4l2_rect bbox;
+	uint32_t tmp;
+	unsigned int i;
+
+	g2d_rect_bbox(rects, count, &bbox);
+	dst.sel.r = bbox;
+
+	g2d_hw_reset(job->g2d);
+
+	for (i = 0; i < count; i++)
+		g2d_fill_layer_set(job, G2D_LAYER_V0 + i, addr, &rects[i], &bbox);
+
+	g2d_bldin_set(job->g2d, &dst, G2D_BLD_PIPE0, 0, 0);
+	g2d_bld_cs_set(job->g2d, &dst);
+
+	/* pipe1 only spans the rectangle UI2 fills */
+	if (count == 4) {
+		ui2.sel.r = rects[3].r;
+		g2d_bldin_set(job->g2d, &ui2, G2D_BLD_PIPE1,
+				rects[3].r.left - bbox.left,
+				rects[3].r.top - bbox.top);
+	}
+
+	g2d_bld_ctl_set(job->g2d, BLD_FACTOR_ONE, BLD_FACTOR_ZERO);
+
+	if (count == 1) {
+		g2d_rop_bypass_set(job->g2d);
+	} else {
+		/* D | S | P */
+		tmp = FIELD_PREP(ROP_INDEX_CODE, 0xfe);
+		g2d_write(job->g2d, ROP_INDEX0, tmp);
+		g2d_write(job->g2d, ROP_INDEX1, tmp);
+		g2d_write(job->g2d, ROP_CTL,
+				FIELD_PREP(ROP_CTL_TYPE, ROP_TYPE_ROP3));
+	}
+
+	g2d_wb_set(job->g2d, &dst, addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Copy the selection of src to that of dst, both being the same size. The
+ * video layer fetches in the source format and write-back stores in the
+ * destination one, so this converts between the two on the way.
+ */
+static void g2d_copy_set(struct sunxi_g2d *g2d, struct g2d_frame *src,
+		dma_addr_t src_addr[3], struct g2d_frame *dst,
+		dma_addr_t dst_addr[3])
+{
+	g2d_hw_reset(g2d);
+
+	/* prepare the mixer video layer */
+	g2d_vlayer_set(g2d, src, src_addr, 0xff);
+
+	g2d_bldin_set(g2d, src, G2D_BLD_PIPE0, 0, 0);
+	g2d_bld_cs_set(g2d, dst);
+	g2d_bld_csc_set(g2d, src, G2D_BLD_PIPE0, dst);
+
+	/* pipe0 is written out untouched */
+	g2d_bld_ctl_set(g2d, BLD_FACTOR_ONE, BLD_FACTOR_ZERO);
+
+	g2d_rop_bypass_set(g2d);
+
+	g2d_wb_set(g2d, dst, dst_addr);
+}
+
+static void g2d_copy(struct sunxi_g2d *g2d, struct g2d_frame *src,
+		dma_addr_t src_addr[3], struct g2d_frame *dst,
+		dma_addr_t dst_addr[3])
+{
+	g2d_copy_set(g2d, src, src_addr, dst, dst_addr);
+
+	/* start the module */
+	g2d_mixer_start(g2d);
+}
+
+void g2d_bitblt(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+
+	/*
+	 * Nothing is scaled, so only the area common to both rectangles
+	 * is copied
+	 */
+	src.sel.r.width = min(src.sel.r.width, dst.sel.r.width);
+	src.sel.r.height = min(src.sel.r.height, dst.sel.r.height);
+	dst.sel.r.width = src.sel.r.width;
+	dst.sel.r.height = src.sel.r.height;
+
+	g2d_tile_clip(job, &dst.sel.r, &src.sel.r);
+
+	g2d_copy(job->g2d, &src, src_addr, &dst, dst_addr);
+}
+
+/*
+ * Move the capture compose rectangle by the move offset, within the capture
+ * buffer. The mixer fetches and writes back the same buffer, so it scans in
+ * the direction of the move for the source to be read before it is
+ * overwritten. Whatever would land outside the frame is dropped. Returns
+ * false when nothing is left to move.
+ */
+bool g2d_move(struct g2d_job *job, dma_addr_t addr[3])
+{
+	struct g2d_frame src = job->dst;
+	struct g2d_frame dst = job->dst;
+	int32_t x = src.sel.r.left + job->move_dx;
+	int32_t y = src.sel.r.top + job->move_dy;
+	int32_t w = src.sel.r.width;
+	int32_t h = src.sel.r.height;
+	uint32_t order = 0;
+
+	/* clip the moved rectangle to the frame */
+	if (x < 0) {
+		src.sel.r.left -= x;
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		src.sel.r.top -= y;
+		h += y;
+		y = 0;
+	}
+	w = min_t(int32_t, w, (int32_t)dst.v4l2_pix_fmt.width - x);
+	h = min_t(int32_t, h, (int32_t)dst.v4l2_pix_fmt.height - y);
+
+	if (w <= 0 || h <= 0)
+		return false;
+
+	src.sel.r.width = w;
+	src.sel.r.height = h;
+	dst.sel.r.left = x;
+	dst.sel.r.top = y;
+	dst.sel.r.width = w;
+	dst.sel.r.height = h;
+
+	src.premult_alpha = false;
+	src.alpha_bld_mode = G2D_PIXEL_ALPHA;
+	dst.premult_alpha = false;
+
+	if (job->move_dx > 0)
+		order |= G2D_SCAN_ORDER_RTL;
+	if (job->move_dy > 0)
+		order |= G2D_SCAN_ORDER_BTT;
+
+	G2D_INFO_MSG("MOVE: (%d,%d) %dx%d to (%d,%d), scan order %u\n",
+			src.sel.r.left, src.sel.r.top, w, h, x, y, order);
+
+	g2d_copy_set(job->g2d, &src, addr, &dst, addr);
+
+	g2d_clr_bits(job->g2d, G2D_MIXER_CTL, G2D_MIXER_CTL_SCAN_ORDER);
+	g2d_set_bits(job->g2d, G2D_MIXER_CTL,
+			FIELD_PREP(G2D_MIXER_CTL_SCAN_ORDER, order));
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+
+	return true;
+}
+
+/*
+ * Clip the rectangle the source is drawn to, out, against win, both being
+ * relative to the destination compose rectangle. The source crop is cut
+ * alike and out is made relative to win. When out is a scaled copy of the
+ * crop, the crop keeps the pixels the filter taps reach and pos gets the
+ * scaling steps and the phases win starts at. out is left empty when it
+ * misses win.
+ */
+static void g2d_src_clip(struct g2d_frame *src, const struct v4l2_rect *win,
+		struct v4l2_rect *out, struct g2d_scale_pos *pos)
+{
+	struct v4l2_rect *crop = &src->sel.r;
+	int32_t l = max(out->left, win->left);
+	int32_t u = max(out->top, win->top);
+	int32_t r = min(out->left + (int32_t)out->width,
+			win->left + (int32_t)win->width);
+	int32_t b = min(out->top + (int32_t)out->height,
+			win->top + (int32_t)win->height);
+	uint32_t x0, x1, y0, y1;
+
+	if (r <= l || b <= u) {
+		out->width = 0;
+		out->height = 0;
+		return;
+	}
+
+	/* the part of the crop landing in win */
+	g2d_scale_axis(l - out->left, r - out->left, crop->width, out->width,
+			&x0, &x1, &pos->hstep, &pos->hphase);
+	g2d_scale_axis(u - out->top, b - out->top, crop->height, out->height,
+			&y0, &y1, &pos->vstep, &pos->vphase);
+
+	crop->left += x0;
+	crop->top += y0;
+	crop->width = x1 - x0;
+	crop->height = y1 - y0;
+
+	out->left = l - win->left;
+	out->top = u - win->top;
+	out->width = r - l;
+	out->height = b - u;
+}
+
+/*
+ * Clear the destination compose rectangle to the rectfill color and copy
+ * the source crop into it at the OUTPUT compose position, in a single pass
+ * writing every pixel once. The blender emits its background color wherever
+ * pipe0 does not reach.
+ */
+void g2d_clear_blit(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+	struct v4l2_rect out = {
+		.left = job->src_compose.left,
+		.top = job->src_compose.top,
+		.width = src.sel.r.width,
+		.height = src.sel.r.height,
+	};
+	struct v4l2_rect win = {
+		.width = dst.sel.r.width,
+		.height = dst.sel.r.height,
+	};
+	struct g2d_scale_pos pos;
+
+	/* The video layer is not scaled here, the source keeps its size */
+	g2d_src_clip(&src, &win, &out, &pos);
+
+	g2d_hw_reset(job->g2d);
+
+	g2d_write(job->g2d, BLD_BK_COLOR,
+			g2d_bk_color(&dst, job->rectfill_color));
+
+	if (out.width && out.height) {
+		g2d_vlayer_set(job->g2d, &src, src_addr, 0xff);
+		g2d_bldin_set(job->g2d, &src, G2D_BLD_PIPE0, out.left, out.top);
+		g2d_bld_csc_set(job->g2d, &src, G2D_BLD_PIPE0, &dst);
+	}
+
+	g2d_bld_cs_set(job->g2d, &dst);
+
+	/* pipe0 is written out untouched */
+	g2d_bld_ctl_set(job->g2d, BLD_FACTOR_ONE, BLD_FACTOR_ZERO);
+
+	g2d_rop_bypass_set(job->g2d);
+
+	g2d_wb_set(job->g2d, &dst, dst_addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Select the area the source and destination frames have in common, within
+ * the current tile
+ */
+static void g2d_full_frames(struct g2d_job *job, struct g2d_frame *src,
+		struct g2d_frame *dst)
+{
+	src->sel.r.left = 0;
+	src->sel.r.top = 0;
+	src->sel.r.width = min(src->v4l2_pix_fmt.width,
+			dst->v4l2_pix_fmt.width);
+	src->sel.r.height = min(src->v4l2_pix_fmt.height,
+			dst->v4l2_pix_fmt.height);
+	dst->sel.r = src->sel.r;
+
+	g2d_tile_clip(job, &dst->sel.r, &src->sel.r);
+}
+
+/*
+ * Convert the whole source frame into the destination format. Selections
+ * are ignored and the alpha channel is carried over as is, with neither
+ * frame taken as premultiplied. Formats without alpha read as opaque.
+ */
+void g2d_convert(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+
+	g2d_full_frames(job, &src, &dst);
+
+	src.premult_alpha = false;
+	src.alpha_bld_mode = G2D_PIXEL_ALPHA;
+	dst.premult_alpha = false;
+
+	g2d_copy(job->g2d, &src, src_addr, &dst, dst_addr);
+}
+
+/*
+ * Convert the whole source frame like g2d_convert, but between straight and
+ * premultiplied alpha. V4L2_PIX_FMT_FLAG_PREMUL_ALPHA on each queue tells
+ * how the frame holds its colors: the layer and pipe0 take the source as
+ * it is, and the blender multiplies the colors by alpha on the way out, or
+ * divides them by it, to match the destination.
+ */
+void g2d_premultiply(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+
+	g2d_full_frames(job, &src, &dst);
+
+	src.alpha_bld_mode = G2D_PIXEL_ALPHA;
+
+	g2d_copy(job->g2d, &src, src_addr, &dst, dst_addr);
+}
+
+/*
+ * Set up the mixer to blend src over the destination compose rectangle, with
+ * the given Porter-Duff factors and src layer alpha. The source is placed and
+ * scaled by the OUTPUT compose selection.
+ */
+static void g2d_blend_set(struct g2d_job *job, struct g2d_frame *frm,
+		dma_addr_t src_addr[3], dma_addr_t dst_addr[3],
+		const uint8_t *factors, uint32_t layer_alpha)
+{
+	struct g2d_frame src = *frm;
+	struct g2d_frame dst = job->dst;
+	struct g2d_frame scaled;
+	struct v4l2_rect out = job->src_compose;
+	struct v4l2_rect win;
+	struct g2d_scale_pos pos;
+
+	g2d_tile_clip(job, &dst.sel.r, NULL);
+
+	/* the tile, relative to the destination compose rectangle */
+	win = dst.sel.r;
+	win.left -= job->dst.sel.r.left;
+	win.top -= job->dst.sel.r.top;
+
+	/* The source crop is scaled to the compose rectangle by the GSU */
+	g2d_src_clip(&src, &win, &out, &pos);
+
+	g2d_hw_reset(job->g2d);
+
+	g2d_vlayer_set(job->g2d, &dst, dst_addr, 0xff);
+	g2d_bldin_set(job->g2d, &dst, G2D_BLD_PIPE0, 0, 0);
+
+	if (out.width && out.height) {
+		g2d_uilayer_set(job->g2d, G2D_LAYER_UI2, &src, src_addr,
+				layer_alpha);
+
+		if (pos.hstep != 1 << VS_STEP_FRAC_BITS ||
+			pos.vstep != 1 << VS_STEP_FRAC_BITS)
+			g2d_gsu_set(job->g2d, src.sel.r.width,
+					src.sel.r.height, out.width, out.height,
+					&pos);
+
+		/* pipe1 takes the layer at its scaled size */
+		scaled = src;
+		scaled.sel.r.width = out.width;
+		scaled.sel.r.height = out.height;
+		g2d_bldin_set(job->g2d, &scaled, G2D_BLD_PIPE1,
+				out.left, out.top);
+		g2d_bld_csc_set(job->g2d, &src, G2D_BLD_PIPE1, &dst);
+	}
+
+	g2d_bld_cs_set(job->g2d, &dst);
+
+	g2d_bld_ctl_set(job->g2d, factors[0], factors[1]);
+
+	g2d_rop_bypass_set(job->g2d);
+
+	g2d_wb_set(job->g2d, &dst, dst_addr);
+}
+
+/*
+ * Blend the source crop over the destination compose rectangle, which is
+ * entirely written back. The source sits at the position the OUTPUT compose
+ * selection gives within it, and what it leaves uncovered is blended with
+ * an empty pipe1, i.e. with transparent black.
+ */
+void g2d_blend(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	g2d_blend_set(job, &job->src, src_addr, dst_addr,
+			g2d_porter_duff_factors[job->bld_mode],
+			job->src_global_alpha);
+	g2d_ck_set(job->g2d, job->ckey_mode, job->ckey_min, job->ckey_max);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Cross-fade the source into the destination, where the source covers it:
+ * out = src * fade_alpha + dst * (1 - fade_alpha). The alpha channel of the
+ * source is ignored, its colors being taken as straight.
+ */
+void g2d_fade(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+
+	src.premult_alpha = false;
+	src.alpha_bld_mode = G2D_GLOBAL_ALPHA;
+
+	g2d_blend_set(job, &src, src_addr, dst_addr,
+			g2d_porter_duff_factors[G2D_BLD_SRC_OVER],
+			job->fade_alpha);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Integer decimation that leaves the VSU at most a 2x downscale, where its
+ * filters still do well. Rounding down would leave it almost a 4x one, no
+ * decimation being used for 1900 to 480.
+ */
+static uint32_t g2d_ds_factor(uint32_t in, uint32_t out)
+{
+	return max(DIV_ROUND_UP(in, 2 * max(out, 1U)), 1U);
+}
+
+/* keep one out of hds pixels and one out of vds lines of the video layer */
+static void g2d_vlayer_ds_set(struct sunxi_g2d *g2d, uint32_t hds,
+		uint32_t vds)
+{
+	uint32_t hctl = 0, vctl = 0;
+
+	G2D_INFO_MSG("V0 downsample: 1/%d, 1/%d\n", hds, vds);
+
+	if (hds > 1)
+		hctl = FIELD_PREP(V0_DS_M, 1) | FIELD_PREP(V0_DS_N, hds);
+	if (vds > 1)
+		vctl = FIELD_PREP(V0_DS_M, 1) | FIELD_PREP(V0_DS_N, vds);
+
+	g2d_write(g2d, V0_HDS_CTL0, hctl);
+	g2d_write(g2d, V0_HDS_CTL1, hctl);
+	g2d_write(g2d, V0_VDS_CTL0, vctl);
+	g2d_write(g2d, V0_VDS_CTL1, vctl);
+}
+
+/*
+ * Scale the source crop to the destination compose rectangle through the
+ * video layer's scaler, within the current tile. The steps are those of the
+ * whole scale, and each tile starts at the exact source position its first
+ * pixel maps to, with only the pixels the filter taps reach fetched around
+ * it, so that tiles join up without seams.
+ */
+void g2d_scale(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+	struct g2d_frame scaled;
+	struct g2d_scale_pos pos;
+	uint32_t fmt_hw_id;
+	uint32_t hsub, vsub;
+	uint32_t hds, vds;
+	uint32_t ds_w, ds_h;
+	uint32_t x0, x1, y0, y1;
+	uint32_t tmp;
+
+	/*
+	 * Large downscales are split into a coarse decimation by the video
+	 * layer, which skips the pixels and lines it drops, and a fine
+	 * filtered scale by the VSU
+	 */
+	hds = g2d_ds_factor(job->src.sel.r.width, job->dst.sel.r.width);
+	vds = g2d_ds_factor(job->src.sel.r.height, job->dst.sel.r.height);
+	ds_w = DIV_ROUND_UP(job->src.sel.r.width, hds);
+	ds_h = DIV_ROUND_UP(job->src.sel.r.height, vds);
+
+	pos.hstep = g2d_vsu_step(ds_w, job->dst.sel.r.width);
+	pos.vstep = g2d_vsu_step(ds_h, job->dst.sel.r.height);
+
+	g2d_tile_clip(job, &dst.sel.r, NULL);
+
+	/* the decimated source pixels this tile is computed from */
+	fmt_hw_id = v4l2_fmt_to_hw_id(&src.v4l2_pix_fmt);
+	fmt2subsampling(fmt_hw_id, &hsub, &vsub);
+	g2d_scale_span(dst.sel.r.left - job->dst.sel.r.left, dst.sel.r.width,
+			pos.hstep, ds_w, hsub, &x0, &x1, &pos.hphase);
+	g2d_scale_span(dst.sel.r.top - job->dst.sel.r.top, dst.sel.r.height,
+			pos.vstep, ds_h, vsub, &y0, &y1, &pos.vphase);
+
+	src.sel.r.left += x0 * hds;
+	src.sel.r.top += y0 * vds;
+	src.sel.r.width = min((x1 - x0) * hds, job->src.sel.r.width - x0 * hds);
+	src.sel.r.height = min((y1 - y0) * vds,
+			job->src.sel.r.height - y0 * vds);
+
+	/* the blender only sees the scaled layer */
+	scaled = src;
+	scaled.sel.r.width = dst.sel.r.width;
+	scaled.sel.r.height = dst.sel.r.height;
+
+	g2d_hw_reset(job->g2d);
+
+	/* prepare the mixer video layer */
+	g2d_vlayer_set(job->g2d, &src, src_addr, 0xff);
+
+	/* the layer outputs the decimated size */
+	g2d_vlayer_ds_set(job->g2d, hds, vds);
+	tmp = FIELD_PREP(V0_MBSIZE_WIDTH, x1 - x0 - 1);
+	tmp |= FIELD_PREP(V0_MBSIZE_HEIGHT, y1 - y0 - 1);
+	g2d_write(job->g2d, V0_SIZE, tmp);
+
+	g2d_vsu_set(job->g2d, fmt_hw_id, x1 - x0, y1 - y0,
+			dst.sel.r.width, dst.sel.r.height, &pos, 0xff);
+
+	g2d_bldin_set(job->g2d, &scaled, G2D_BLD_PIPE0, 0, 0);
+	g2d_bld_cs_set(job->g2d, &dst);
+	g2d_bld_csc_set(job->g2d, &src, G2D_BLD_PIPE0, &dst);
+
+	/* pipe0 is written out untouched */
+	g2d_bld_ctl_set(job->g2d, BLD_FACTOR_ONE, BLD_FACTOR_ZERO);
+
+	g2d_rop_bypass_set(job->g2d);
+
+	g2d_wb_set(job->g2d, &dst, dst_addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Rotate and/or mirror the source crop rectangle into the destination
+ * compose rectangle. This runs on the rotator instead of the mixer.
+ */
+void g2d_rotate(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct sunxi_g2d *g2d = job->g2d;
+	struct v4l2_rect in = job->src.sel.r;
+	struct v4l2_rect out = job->dst.sel.r;
+	uint32_t rotation = job->rotation;
+	bool hflip = job->hflip;
+	dma_addr_t addr[3];
+	uint32_t pitch[3];
+	uint32_t fmt_hw_id;
+	uint32_t tmp;
+
+	/* the rotator only mirrors horizontally, a vflip is an hflip + 180 */
+	if (job->vflip) {
+		hflip = !hflip;
+		rotation = (rotation + 180) % 360;
+	}
+
+	/* nothing is scaled, so only rotate what fits the destination */
+	if (rotation == 90 || rotation == 270) {
+		in.width = min(in.width, out.height);
+		in.height = min(in.height, out.width);
+		out.width = in.height;
+		out.height = in.width;
+	} else {
+		in.width = min(in.width, out.width);
+		in.height = min(in.height, out.height);
+		out.width = in.width;
+		out.height = in.height;
+	}
+
+	g2d_rot_reset(g2d);
+
+	tmp = ROT_CTL_EN | FIELD_PREP(ROT_CTL_DEGREE, rotation / 90);
+	if (hflip)
+		tmp |= ROT_CTL_HFLIP;
+	g2d_write(g2d, ROT_CTL, tmp);
+
+	fmt_hw_id = v4l2_fmt_to_hw_id(&job->src.v4l2_pix_fmt);
+	g2d_write(g2d, ROT_IFMT, FIELD_PREP(ROT_IFMT_FBFMT, fmt_hw_id));
+
+	tmp = FIELD_PREP(ROT_SIZE_WIDTH, in.width - 1);
+	tmp |= FIELD_PREP(ROT_SIZE_HEIGHT, in.height - 1);
+	g2d_write(g2d, ROT_ISIZE, tmp);
+
+	g2d_frame_planes(&job->src, &in, src_addr, pitch, addr);
+	g2d_write(g2d, ROT_IPITCH0, pitch[0]);
+	g2d_write(g2d, ROT_IPITCH1, pitch[1]);
+	g2d_write(g2d, ROT_IPITCH2, pitch[2]);
+	g2d_write(g2d, ROT_ILADD0, lower_32_bits(addr[0]));
+	g2d_write(g2d, ROT_ILADD1, lower_32_bits(addr[1]));
+	g2d_write(g2d, ROT_ILADD2, lower_32_bits(addr[2]));
+#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
+	if (g2d->variant->addr_40bit) {
+		g2d_write(g2d, ROT_IHADD0, upper_32_bits(addr[0]));
+		g2d_write(g2d, ROT_IHADD1, upper_32_bits(addr[1]));
+		g2d_write(g2d, ROT_IHADD2, upper_32_bits(addr[2]));
+	}
+#endif
+
+	tmp = FIELD_PREP(ROT_SIZE_WIDTH, out.width - 1);
+	tmp |= FIELD_PREP(ROT_SIZE_HEIGHT, out.height - 1);
+	g2d_write(g2d, ROT_OSIZE, tmp);
+
+	g2d_frame_planes(&job->dst, &out, dst_addr, pitch, addr);
+	g2d_write(g2d, ROT_OPITCH0, pitch[0]);
+	g2d_write(g2d, ROT_OPITCH1, pitch[1]);
+	g2d_write(g2d, ROT_OPITCH2, pitch[2]);
+	g2d_write(g2d, ROT_OLADD0, lower_32_bits(addr[0]));
+	g2d_write(g2d, ROT_OLADD1, lower_32_bits(addr[1]));
+	g2d_write(g2d, ROT_OLADD2, lower_32_bits(addr[2]));
+#ifdef CONFIG_ARCH_DMA_ADDR_T_64BIT
+	if (g2d->variant->addr_40bit) {
+		g2d_write(g2d, ROT_OHADD0, upper_32_bits(addr[0]));
+		g2d_write(g2d, ROT_OHADD1, upper_32_bits(addr[1]));
+		g2d_write(g2d, ROT_OHADD2, upper_32_bits(addr[2]));
+	}
+#endif
+
+	G2D_INFO_MSG("Starting the rotator");
+	g2d_rot_irq_enable(g2d);
+	g2d_set_bits(g2d, ROT_CTL, ROT_CTL_START);
+}
+
+/*
+ * Combine the source crop rectangle (S), the destination compose rectangle
+ * (D) and a solid pattern color (P) with a GDI style ROP3 code, writing the
+ * result back in place of D. The pattern is the fill color of UI1.
+ */
+void g2d_rop(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3])
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+	uint32_t tmp;
+
+	/* Nothing is scaled, so only the common area is combined */
+	src.sel.r.width = min(src.sel.r.width, dst.sel.r.width);
+	src.sel.r.height = min(src.sel.r.height, dst.sel.r.height);
+	dst.sel.r.width = src.sel.r.width;
+	dst.sel.r.height = src.sel.r.height;
+
+	g2d_hw_reset(job->g2d);
+
+	g2d_vlayer_set(job->g2d, &dst, dst_addr, 0xff);
+	g2d_uilayer_set(job->g2d, G2D_LAYER_UI0, &src, src_addr, 0xff);
+	g2d_uilayer_set(job->g2d, G2D_LAYER_UI1, &dst, dst_addr, 0xff);
+	g2d_fc_set(job->g2d, G2D_LAYER_UI1, job->rop_pattern_color);
+
+	g2d_bldin_set(job->g2d, &dst, G2D_BLD_PIPE0, 0, 0);
+	g2d_bld_cs_set(job->g2d, &dst);
+
+	/* pipe0 is written out untouched */
+	g2d_bld_ctl_set(job->g2d, BLD_FACTOR_ONE, BLD_FACTOR_ZERO);
+
+	/* no mask is used, both indexes hold the same code */
+	tmp = FIELD_PREP(ROP_INDEX_CODE, job->rop_code);
+	g2d_write(job->g2d, ROP_INDEX0, tmp);
+	g2d_write(job->g2d, ROP_INDEX1, tmp);
+	g2d_write(job->g2d, ROP_CTL, FIELD_PREP(ROP_CTL_TYPE, ROP_TYPE_ROP3));
+
+	g2d_wb_set(job->g2d, &dst, dst_addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
+
+/*
+ * Draw one compose layer over the destination. The blender only has two
+ * inputs, so layers are stacked one pass at a time, each pass only reading
+ * and writing the area the layer covers.
+ */
+void g2d_compose_layer(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3], struct g2d_compose_layer *layer)
+{
+	struct g2d_frame src = job->src;
+	struct g2d_frame dst = job->dst;
+	const uint8_t *factors = g2d_porter_duff_factors[G2D_BLD_SRC_OVER];
+
+	src.sel.r = layer->src;
+	src.premult_alpha = layer->premult_alpha;
+	/* pixel alpha scaled by the layer alpha */
+	src.alpha_bld_mode = G2D_MIXER_ALPHA;
+
+	dst.sel.r.left = layer->dst_left;
+	dst.sel.r.top = layer->dst_top;
+	dst.sel.r.width = layer->src.width;
+	dst.sel.r.height = layer->src.height;
+
+	G2D_INFO_MSG("COMPOSE: zpos %d, (%d,%d) %dx%d at (%d,%d)\n",
+			layer->zpos, layer->src.left, layer->src.top,
+			layer->src.width, layer->src.height,
+			layer->dst_left, layer->dst_top);
+
+	g2d_hw_reset(job->g2d);
+
+	g2d_vlayer_set(job->g2d, &dst, dst_addr, 0xff);
+	g2d_uilayer_set(job->g2d, G2D_LAYER_UI2, &src, src_addr,
+			layer->global_alpha);
+
+	g2d_bldin_set(job->g2d, &dst, G2D_BLD_PIPE0, 0, 0);
+	g2d_bldin_set(job->g2d, &src, G2D_BLD_PIPE1, 0, 0);
+	g2d_bld_cs_set(job->g2d, &dst);
+	g2d_bld_csc_set(job->g2d, &src, G2D_BLD_PIPE1, &dst);
+
+	g2d_bld_ctl_set(job->g2d, factors[0], factors[1]);
+
+	g2d_rop_bypass_set(job->g2d);
+
+	g2d_wb_set(job->g2d, &dst, dst_addr);
+
+	/* start the module */
+	g2d_mixer_start(job->g2d);
+}
@@ -73,6 +73,28 @@ enum g2d_fmt_hw_id {
 	G2D_FORMAT_MAX,
 };
 
+static inline bool g2d_fmt_is_yuv(uint32_t fmt_hw_id)
+{
+	return fmt_hw_id > G2D_FORMAT_BGRA1010102;
+}
+
+/* Mixer input layers */
+enum g2d_layer {
+	G2D_LAYER_V0,
+	G2D_LAYER_UI0,
+	G2D_LAYER_UI1,
+	G2D_LAYER_UI2,
+};
+
+/*
+ * Blender input pipes. V0, UI0 and UI1 go through the ROP unit into pipe0
+ * while UI2 alone feeds pipe1
+ */
+enum g2d_bld_pipe {
+	G2D_BLD_PIPE0,
+	G2D_BLD_PIPE1,
+};
+
 /* TODO: 
  * setup debug_info as a sysfs attribute that controls
  * G2D_INFO_MSG
@@ -90,10 +112,43 @@ extern uint32_t debug_info;
 		pr_warn("[G2D] (%s) line:%d: " fmt, __func__, __LINE__, ##args);\
 	} while (0)
 
+extern const struct g2d_reg_ops g2d_mmio_reg_ops;
+
 void g2d_hw_open(struct sunxi_g2d *g2d);
 void g2d_hw_close(struct sunxi_g2d *g2d);
 int g2d_mixer_irq_query(struct sunxi_g2d *g2d);
 void g2d_mixer_reset(struct sunxi_g2d *g2d);
-void g2d_rectfill(struct sunxi_g2d_ctx *ctx, dma_addr_t addr[3]);
+int g2d_rot_irq_query(struct sunxi_g2d *g2d);
+void g2d_rot_reset(struct sunxi_g2d *g2d);
+void fmt2subsampling(uint32_t format, uint32_t *hsub, uint32_t *vsub);
+void g2d_fmt_plane_sizes(uint32_t fmt_hw_id, uint32_t width, uint32_t height,
+		uint32_t alignment, uint32_t pitch[3], uint32_t size[3]);
+void g2d_rectfill(struct g2d_job *job, dma_addr_t addr[3]);
+void g2d_clear(struct g2d_job *job, dma_addr_t addr[3]);
+unsigned int g2d_rectfill_pack(const struct g2d_variant *variant,
+		struct g2d_fill_rect *rects, unsigned int count);
+void g2d_rectfill_multi(struct g2d_job *job, dma_addr_t addr[3],
+		struct g2d_fill_rect *rects, unsigned int count);
+void g2d_bitblt(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+bool g2d_move(struct g2d_job *job, dma_addr_t addr[3]);
+void g2d_clear_blit(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_convert(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_premultiply(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_blend(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_fade(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_scale(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_rotate(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_rop(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3]);
+void g2d_compose_layer(struct g2d_job *job, dma_addr_t src_addr[3],
+		dma_addr_t dst_addr[3], struct g2d_compose_layer *layer);
 
 #endif
\ No newline at end of file
@@ -45,6 +45,8 @@
 
 #define G2D_MIXER_CTL   (0x00 + G2D_MIXER)
 #define G2D_MIXER_CTL_SCAN_ORDER  GENMASK(5, 4)
+#define G2D_SCAN_ORDER_RTL  BIT(0)	/* right to left */
+#define G2D_SCAN_ORDER_BTT  BIT(1)	/* bottom to top */
 #define G2D_MIXER_CTL_BIST_EN  BIT(8)
 #define G2D_MIXER_CTL_START  BIT(31)
 
@@ -69,7 +71,11 @@
 #define V0_MBSIZE_WIDTH   GENMASK(12, 0)
 #define V0_MBSIZE_HEIGHT  GENMASK(28, 16)
 
+/* V0_COOR and UI_COOR: layer position inside the channel window */
 #define V0_COOR         (0x08 + G2D_V0)
+#define LAY_COOR_X        GENMASK(15, 0)
+#define LAY_COOR_Y        GENMASK(31, 16)
+
 #define V0_PITCH0       (0x0C + G2D_V0)
 #define V0_PITCH1       (0x10 + G2D_V0)
 #define V0_PITCH2       (0x14 + G2D_V0)
@@ -88,6 +94,34 @@
 #define V0_HDS_CTL1     (0x34 + G2D_V0)
 #define V0_VDS_CTL0     (0x38 + G2D_V0)
 #define V0_VDS_CTL1     (0x3C + G2D_V0)
+/*
+ * V0 downsampling, CTL0 for luma and CTL1 for chroma: M out of every N
+ * fetched pixels (or lines) are kept. Zero disables it.
+ */
+#define V0_DS_M    GENMASK(15, 0)
+#define V0_DS_N    GENMASK(31, 16)
+
+/* UI layer registers, n being the UI layer index (0, 1 or 2) */
+#define G2D_UI_LAYER(n)  (G2D_UI0 + (n) * 0x800)
+
+#define UI_ATTR(n)      (0x00 + G2D_UI_LAYER(n))
+#define UI_ATTR_EN            BIT(0)
+#define UI_ATTR_ALPHA_MODE    GENMASK(2, 1)
+#define UI_ATTR_FILLCOLOR_EN  BIT(4)
+#define UI_ATTR_FBFMT         GENMASK(12, 8)
+#define UI_ATTR_PREMUL_CTL    GENMASK(17, 16)
+#define UI_ATTR_GLBALPHA      GENMASK(31, 24)
+
+#define UI_MBSIZE(n)    (0x04 + G2D_UI_LAYER(n))
+#define UI_MBSIZE_WIDTH   GENMASK(12, 0)
+#define UI_MBSIZE_HEIGHT  GENMASK(28, 16)
+
+#define UI_COOR(n)      (0x08 + G2D_UI_LAYER(n))
+#define UI_PITCH(n)     (0x0C + G2D_UI_LAYER(n))
+#define UI_LADD(n)      (0x10 + G2D_UI_LAYER(n))
+#define UI_FILLC(n)     (0x14 + G2D_UI_LAYER(n))
+#define UI_HADD(n)      (0x18 + G2D_UI_LAYER(n))
+#define UI_SIZE(n)      (0x1C + G2D_UI_LAYER(n))
 
 /* LAY0 UI register */
 #define UI0_ATTR        (0x00 + G2D_UI0)
@@ -121,6 +155,9 @@
 
 /* VSU register */
 #define VS_CTRL         (0x000 + G2D_VSU)
+#define VS_CTRL_EN           BIT(0)
+#define VS_CTRL_COEF_SWITCH  BIT(4)
+
 #define VS_OUT_SIZE     (0x040 + G2D_VSU)
 #define VS_GLB_ALPHA    (0x044 + G2D_VSU)
 #define VS_Y_SIZE       (0x080 + G2D_VSU)
@@ -137,6 +174,41 @@
 #define VS_Y_VCOEF0     (0x300 + G2D_VSU)
 #define VS_C_HCOEF0     (0x400 + G2D_VSU)
 
+/* VS_OUT_SIZE, VS_Y_SIZE and VS_C_SIZE */
+#define VS_SIZE_WIDTH   GENMASK(12, 0)
+#define VS_SIZE_HEIGHT  GENMASK(28, 16)
+
+/* Steps and phases are fixed point numbers with 20 fractional bits */
+#define VS_STEP_FRAC_BITS  20
+#define VS_STEP_VAL        GENMASK(23, 0)
+#define VS_PHASE_VAL       GENMASK(23, 0)
+
+/* Each coefficient bank holds 4 taps for each of the 32 phases */
+#define VS_PHASE_NUM    32
+
+/* The taps reach one pixel left of the sample point and two right of it */
+#define VS_TAPS_LEFT    1
+#define VS_TAPS_RIGHT   2
+
+/*
+ * GSU register, scaling the UI layer feeding pipe1. It is an RGB only,
+ * single channel version of the VSU and shares its size and step layout.
+ */
+#define GS_CTRL         (0x000 + G2D_GSU)
+#define GS_CTRL_EN           BIT(0)
+#define GS_CTRL_COEF_SWITCH  BIT(4)
+
+#define GS_OUT_SIZE     (0x040 + G2D_GSU)
+#define GS_IN_SIZE      (0x080 + G2D_GSU)
+#define GS_HSTEP        (0x088 + G2D_GSU)
+#define GS_VSTEP        (0x08C + G2D_GSU)
+#define GS_HPHASE       (0x090 + G2D_GSU)
+#define GS_VPHASE       (0x098 + G2D_GSU)
+#define GS_HCOEF0       (0x200 + G2D_GSU)
+
+/* Each coefficient bank holds 4 taps for each of the 16 phases */
+#define GS_PHASE_NUM    16
+
 /* MIXER VIDEO BLENDER registers */
 #define G2D_BLD         (0x00400)
 
@@ -150,8 +222,11 @@
 #define BLD_FILLC1      (0x014 + G2D_BLD)
 #define BLD_CH_ISIZE0   (0x020 + G2D_BLD)
 #define BLD_CH_ISIZE1   (0x024 + G2D_BLD)
+/* position of the input in the output, unlike the sizes not minus one */
 #define BLD_CH_OFFSET0  (0x030 + G2D_BLD)
 #define BLD_CH_OFFSET1  (0x034 + G2D_BLD)
+#define BLD_CH_OFFSET_X  GENMASK(15, 0)
+#define BLD_CH_OFFSET_Y  GENMASK(31, 16)
 
 #define BLD_PREMUL_CTL  (0x040 + G2D_BLD)
 #define BLD_PREMUL_CTL_PIPE0_ALPHA_MODE  BIT(0)
@@ -160,15 +235,36 @@
 #define BLD_BK_COLOR    (0x044 + G2D_BLD)
 #define BLD_OUT_SIZE    (0x048 + G2D_BLD)
 #define BLD_CTL         (0x04C + G2D_BLD)
+#define BLD_CTL_PIXEL_SRC_FACTOR  GENMASK(3, 0)
+#define BLD_CTL_PIXEL_DST_FACTOR  GENMASK(11, 8)
+#define BLD_CTL_ALPHA_SRC_FACTOR  GENMASK(19, 16)
+#define BLD_CTL_ALPHA_DST_FACTOR  GENMASK(27, 24)
+
+/* BLD_CTL blend factors. The alpha is always the one of the other pipe */
+#define BLD_FACTOR_ZERO          0x0
+#define BLD_FACTOR_ONE           0x1
+#define BLD_FACTOR_ALPHA         0x2
+#define BLD_FACTOR_INV_ALPHA     0x3
+
 #define BLD_KEY_CTL     (0x050 + G2D_BLD)
+#define BLD_KEY_CTL_EN       BIT(0)
+#define BLD_KEY_CTL_SRC      BIT(1)
+
 #define BLD_KEY_CON     (0x054 + G2D_BLD)
+
+/* BLD_KEY_MAX and BLD_KEY_MIN */
 #define BLD_KEY_MAX     (0x058 + G2D_BLD)
 #define BLD_KEY_MIN     (0x05C + G2D_BLD)
+#define BLD_KEY_COLOR        GENMASK(23, 0)
 
 #define BLD_OUT_COLOR   (0x060 + G2D_BLD)
 #define BLD_OUT_COLOR_PREMUL_EN  BIT(0)
 #define BLD_OUT_COLOR_ALPHA_MODE  BIT(1)
 
+/*
+ * The ROP unit combines the V0 (ch0), UI0 (ch1) and UI1 (ch2) channels
+ * before they reach pipe0. A bypassed color component is taken from ch0.
+ */
 #define ROP_CTL         (0x080 + G2D_BLD)
 #define ROP_CTL_TYPE  BIT(0)
 #define ROP_CTL_BLUE_BYPASS_EN  BIT(4)
@@ -176,9 +272,19 @@
 #define ROP_CTL_RED_BYPASS_EN  BIT(6)
 #define ROP_CTL_ALPHA_BYPASS_EN  BIT(7)
 
+/* ROP_CTL_TYPE values */
+#define ROP_TYPE_ROP2  0x0
+#define ROP_TYPE_ROP3  0x1
+
+/* ROP3 codes, ch0 being the destination, ch1 the source and ch2 the pattern */
 #define ROP_INDEX0      (0x084 + G2D_BLD)
 #define ROP_INDEX1      (0x088 + G2D_BLD)
+#define ROP_INDEX_CODE  GENMASK(7, 0)
 #define BLD_CSC_CTL     (0x100 + G2D_BLD)
+#define BLD_CSC_CTL_CSC0_EN  BIT(0)
+#define BLD_CSC_CTL_CSC1_EN  BIT(1)
+#define BLD_CSC_CTL_CSC2_EN  BIT(2)
+
 #define BLD_CSC0_COEF00 (0x110 + G2D_BLD)
 #define BLD_CSC0_COEF01 (0x114 + G2D_BLD)
 #define BLD_CSC0_COEF02 (0x118 + G2D_BLD)
@@ -235,10 +341,25 @@
 
 /* Rotate registers */
 #define ROT_CTL            (0x00 + G2D_ROT)
+#define ROT_CTL_EN        BIT(0)
+#define ROT_CTL_DEGREE    GENMASK(5, 4)
+#define ROT_CTL_HFLIP     BIT(7)
+#define ROT_CTL_START     BIT(31)
+
 #define ROT_INT            (0x04 + G2D_ROT)
+#define ROT_INT_IRQ_PENDING    BIT(0)
+#define ROT_INT_FINISH_IRQ_EN  BIT(16)
+
 #define ROT_TIMEOUT        (0x08 + G2D_ROT)
+
 #define ROT_IFMT           (0x20 + G2D_ROT)
+#define ROT_IFMT_FBFMT    GENMASK(5, 0)
+
+/* ROT_ISIZE and ROT_OSIZE */
 #define ROT_ISIZE          (0x24 + G2D_ROT)
+#define ROT_SIZE_WIDTH    GENMASK(12, 0)
+#define ROT_SIZE_HEIGHT   GENMASK(28, 16)
+
 #define ROT_IPITCH0        (0x30 + G2D_ROT)
 #define ROT_IPITCH1        (0x34 + G2D_ROT)
 #define ROT_IPITCH2        (0x38 + G2D_ROT)
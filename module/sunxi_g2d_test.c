@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Allwinner G2D - KUnit tests of the register programming
+ *
+ * The ops are run against a fake register file instead of the hardware, and
+ * the values they leave in it are checked.
+ *
+ * Copyright (C) 2024 Brandon Cheo Fusi <fusibrandon13@gmail.com>
+ */
+
+#include <kunit/test.h>
+#include <linux/bitfield.h>
+
+#include "sunxi_g2d.h"
+#include "sunxi_g2d_hw.h"
+#include "sunxi_g2d_regs.h"
+
+/*
+ * covers every block, the last one being the GSU, whose horizontal
+ * coefficients are its last registers
+ */
+#define G2D_TEST_REGS_SIZE	(GS_HCOEF0 + GS_PHASE_NUM * 4)
+
+#define G2D_TEST_SRC_ADDR	0x40000000
+#define G2D_TEST_SRC_UV_ADDR	0x44000000
+#define G2D_TEST_DST_ADDR	0x48000000
+
+struct g2d_test_dev {
+	struct sunxi_g2d g2d;
+	struct g2d_job job;
+	uint32_t regs[G2D_TEST_REGS_SIZE / 4];
+};
+
+static uint32_t g2d_test_read(struct sunxi_g2d *g2d, uint32_t reg)
+{
+	struct g2d_test_dev *dev = container_of(g2d, struct g2d_test_dev, g2d);
+
+	if (WARN_ON(reg >= G2D_TEST_REGS_SIZE))
+		return 0;
+
+	return dev->regs[reg / 4];
+}
+
+static void g2d_test_write(struct sunxi_g2d *g2d, uint32_t reg, uint32_t val)
+{
+	struct g2d_test_dev *dev = container_of(g2d, struct g2d_test_dev, g2d);
+
+	if (WARN_ON(reg >= G2D_TEST_REGS_SIZE))
+		return;
+
+	dev->regs[reg / 4] = val;
+}
+
+static const struct g2d_reg_ops g2d_test_reg_ops = {
+	.read = g2d_test_read,
+	.write = g2d_test_write,
+};
+
+static const struct g2d_variant g2d_test_variant = {
+	.max_width = G2D_MAX_WIDTH,
+	.max_height = G2D_MAX_HEIGHT,
+	.pass_width = 2048,
+	.pass_height = 2048,
+	.has_rotator = true,
+	.mod_rate = 300000000,
+};
+
+static void g2d_test_frame(struct g2d_frame *frm, uint32_t fourcc,
+		uint32_t width, uint32_t height, uint32_t left, uint32_t top,
+		uint32_t sel_width, uint32_t sel_height)
+{
+	frm->v4l2_pix_fmt.pixelformat = fourcc;
+	frm->v4l2_pix_fmt.width = width;
+	frm->v4l2_pix_fmt.height = height;
+	frm->alignment = 1;
+	frm->alpha_bld_mode = G2D_PIXEL_ALPHA;
+	frm->sel.r.left = left;
+	frm->sel.r.top = top;
+	frm->sel.r.width = sel_width;
+	frm->sel.r.height = sel_height;
+}
+
+static struct g2d_test_dev *g2d_test_dev_alloc(struct kunit *test)
+{
+	struct g2d_test_dev *dev;
+
+	dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	dev->g2d.variant = &g2d_test_variant;
+	dev->g2d.reg_ops = &g2d_test_reg_ops;
+	dev->job.g2d = &dev->g2d;
+
+	return dev;
+}
+
+static uint32_t g2d_test_reg(struct g2d_test_dev *dev, uint32_t reg)
+{
+	return dev->regs[reg / 4];
+}
+
+/* run a bitblt whose single tile is the whole destination compose rectangle */
+static void g2d_test_bitblt(struct g2d_test_dev *dev)
+{
+	dma_addr_t src_addr[3] = { G2D_TEST_SRC_ADDR, G2D_TEST_SRC_UV_ADDR };
+	dma_addr_t dst_addr[3] = { G2D_TEST_DST_ADDR };
+
+	dev->job.tile = dev->job.dst.sel.r;
+	g2d_bitblt(&dev->job, src_addr, dst_addr);
+}
+
+static void g2d_test_bitblt_regs(struct kunit *test)
+{
+	struct g2d_test_dev *dev = g2d_test_dev_alloc(test);
+	uint32_t size;
+
+	g2d_test_frame(&dev->job.src, V4L2_PIX_FMT_XBGR32, 640, 480,
+			10, 20, 100, 50);
+	g2d_test_frame(&dev->job.dst, V4L2_PIX_FMT_XBGR32, 320, 240,
+			30, 40, 100, 50);
+
+	g2d_test_bitblt(dev);
+
+	size = FIELD_PREP(V0_MBSIZE_WIDTH, 99) |
+		FIELD_PREP(V0_MBSIZE_HEIGHT, 49);
+
+	/* the video layer fetches the source crop */
+	KUNIT_EXPECT_TRUE(test, g2d_test_reg(dev, V0_ATTCTL) & V0_ATTCTL_EN);
+	KUNIT_EXPECT_EQ(test,
+			FIELD_GET(V0_ATTCTL_FBFMT, g2d_test_reg(dev, V0_ATTCTL)),
+			G2D_FORMAT_XRGB8888);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_MBSIZE), size);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_PITCH0), 640 * 4);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_LADDR0),
+			G2D_TEST_SRC_ADDR + 640 * 4 * 20 + 4 * 10);
+
+	/* write-back stores it at the destination compose rectangle */
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_ATT), G2D_FORMAT_XRGB8888);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_SIZE),
+			FIELD_PREP(WB_SIZE_WIDTH, 99) |
+			FIELD_PREP(WB_SIZE_HEIGHT, 49));
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_PITCH0), 320 * 4);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_LADD0),
+			G2D_TEST_DST_ADDR + 320 * 4 * 40 + 4 * 30);
+
+	KUNIT_EXPECT_TRUE(test,
+			g2d_test_reg(dev, G2D_MIXER_CTL) & G2D_MIXER_CTL_START);
+}
+
+/* only the area common to both rectangles is copied */
+static void g2d_test_bitblt_clip(struct kunit *test)
+{
+	struct g2d_test_dev *dev = g2d_test_dev_alloc(test);
+	uint32_t size;
+
+	g2d_test_frame(&dev->job.src, V4L2_PIX_FMT_RGB565, 640, 480,
+			0, 0, 200, 100);
+	g2d_test_frame(&dev->job.dst, V4L2_PIX_FMT_RGB565, 640, 480,
+			8, 8, 50, 60);
+
+	g2d_test_bitblt(dev);
+
+	size = FIELD_PREP(V0_MBSIZE_WIDTH, 49) |
+		FIELD_PREP(V0_MBSIZE_HEIGHT, 59);
+
+	KUNIT_EXPECT_EQ(test,
+			FIELD_GET(V0_ATTCTL_FBFMT, g2d_test_reg(dev, V0_ATTCTL)),
+			G2D_FORMAT_RGB565);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_MBSIZE), size);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_PITCH0), 640 * 2);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_LADDR0), G2D_TEST_SRC_ADDR);
+
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_SIZE), size);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_PITCH0), 640 * 2);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, WB_LADD0),
+			G2D_TEST_DST_ADDR + 640 * 2 * 8 + 2 * 8);
+}
+
+/* NV12 has its chroma plane start with U, which the G2D calls V1U1V0U0 */
+static void g2d_test_bitblt_nv12(struct kunit *test)
+{
+	struct g2d_test_dev *dev = g2d_test_dev_alloc(test);
+
+	g2d_test_frame(&dev->job.src, V4L2_PIX_FMT_NV12, 640, 480,
+			16, 8, 64, 32);
+	g2d_test_frame(&dev->job.dst, V4L2_PIX_FMT_XBGR32, 320, 240,
+			0, 0, 64, 32);
+
+	g2d_test_bitblt(dev);
+
+	KUNIT_EXPECT_EQ(test,
+			FIELD_GET(V0_ATTCTL_FBFMT, g2d_test_reg(dev, V0_ATTCTL)),
+			G2D_FORMAT_YUV420UVC_V1U1V0U0);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_PITCH0), 640);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_PITCH1), 640);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_LADDR0),
+			G2D_TEST_SRC_ADDR + 640 * 8 + 16);
+	KUNIT_EXPECT_EQ(test, g2d_test_reg(dev, V0_LADDR1),
+			G2D_TEST_SRC_UV_ADDR + 640 * 4 + 2 * 8);
+}
+
+static struct kunit_case g2d_test_cases[] = {
+	KUNIT_CASE(g2d_test_bitblt_regs),
+	KUNIT_CASE(g2d_test_bitblt_clip),
+	KUNIT_CASE(g2d_test_bitblt_nv12),
+	{}
+};
+
+static struct kunit_suite g2d_test_suite = {
+	.name = "sunxi-g2d",
+	.test_cases = g2d_test_cases,
+};
+
+kunit_test_suite(g2d_test_suite);